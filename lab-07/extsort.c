@@ -0,0 +1,388 @@
+// Lab 7 - External merge sort of fixed-size records
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "extsort.h"
+
+// Reading runs in smaller pieces than this spends more time seeking than
+// reading, so merges take in no more runs than fit with this much each
+#define MIN_RUN_BUFFER (64 * 1024)
+#define MIN_RUNS_CAPACITY 16
+
+// A sorted run: count records from offset on in the sorter's file
+typedef struct {
+    off_t offset;
+    size_t count;
+} run_t;
+
+// Reads one run a buffer at a time
+typedef struct {
+    off_t offset; // of the next byte to read
+    size_t left;  // records not read into the buffer yet
+    char *buf;
+    size_t size; // bytes the buffer holds, a whole number of records
+    size_t pos;  // bytes of the buffer handed out
+    size_t len;  // bytes of the buffer filled
+} reader_t;
+
+// A k-way merge: a min-heap of readers keyed by their current records
+typedef struct {
+    reader_t *readers;
+    size_t *heap;
+    size_t heap_len;
+    int popped; // whether the top's current record has been handed out
+    char *buffers;
+} merger_t;
+
+struct extsort {
+    size_t record_size;
+    extsort_cmp_t cmp;
+    int fd;
+
+    // Guards the runs, end and failed while runs are added
+    pthread_mutex_t lock;
+    off_t end; // of the file
+    run_t *runs;
+    size_t num_runs;
+    size_t runs_capacity;
+    int failed;
+
+    merger_t merger;
+    int merging;
+};
+
+static int write_all(int fd, const char *p, size_t n, off_t offset) {
+    while (n > 0) {
+        ssize_t written = pwrite(fd, p, n, offset);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("pwrite");
+            return -1;
+        }
+        p += written;
+        n -= written;
+        offset += written;
+    }
+    return 0;
+}
+
+static int open_temp_file(const char *dir) {
+    size_t len = strlen(dir) + sizeof("/extsort-XXXXXX");
+    char *path = malloc(len);
+    if (path == NULL) {
+        perror("malloc");
+        return -1;
+    }
+    snprintf(path, len, "%s/extsort-XXXXXX", dir);
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror(path);
+    } else {
+        unlink(path);
+    }
+    free(path);
+    return fd;
+}
+
+// Give back the disk space of a run that has been merged into another
+static void release_run(const extsort_t *sorter, const run_t *run) {
+#ifdef FALLOC_FL_PUNCH_HOLE
+    fallocate(sorter->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+              run->offset, (off_t)(run->count * sorter->record_size));
+#else
+    (void)sorter;
+    (void)run;
+#endif
+}
+
+// Room at the end of the file for a run of count records. Called with the
+// lock held.
+static int push_run(extsort_t *sorter, size_t count) {
+    if (sorter->num_runs == sorter->runs_capacity) {
+        size_t capacity = sorter->runs_capacity ? sorter->runs_capacity * 2
+                                                : MIN_RUNS_CAPACITY;
+        run_t *runs = realloc(sorter->runs, capacity * sizeof(run_t));
+        if (runs == NULL) {
+            perror("realloc");
+            return -1;
+        }
+        sorter->runs = runs;
+        sorter->runs_capacity = capacity;
+    }
+    sorter->runs[sorter->num_runs++] = (run_t){sorter->end, count};
+    sorter->end += (off_t)(count * sorter->record_size);
+    return 0;
+}
+
+extsort_t *extsort_create(size_t record_size, extsort_cmp_t cmp) {
+    extsort_t *sorter = calloc(1, sizeof(extsort_t));
+    if (sorter == NULL) {
+        perror("calloc");
+        return NULL;
+    }
+    sorter->record_size = record_size;
+    sorter->cmp = cmp;
+    const char *dir = getenv("TMPDIR");
+    sorter->fd = open_temp_file(dir && dir[0] ? dir : "/tmp");
+    if (sorter->fd < 0) {
+        free(sorter);
+        return NULL;
+    }
+    pthread_mutex_init(&sorter->lock, NULL);
+    return sorter;
+}
+
+int extsort_add_run(extsort_t *sorter, void *records, size_t n) {
+    if (n == 0) {
+        return 0;
+    }
+    qsort(records, n, sorter->record_size, sorter->cmp);
+
+    // Take the run's place in the file, then write it outside the lock
+    pthread_mutex_lock(&sorter->lock);
+    int ret = push_run(sorter, n);
+    off_t offset = ret == 0 ? sorter->runs[sorter->num_runs - 1].offset : 0;
+    pthread_mutex_unlock(&sorter->lock);
+    if (ret == 0) {
+        ret = write_all(sorter->fd, records, n * sorter->record_size, offset);
+    }
+    if (ret != 0) {
+        pthread_mutex_lock(&sorter->lock);
+        sorter->failed = 1;
+        pthread_mutex_unlock(&sorter->lock);
+    }
+    return ret;
+}
+
+// Read the next bufferful once the current one is used up. Returns -1 on a
+// read error; an exhausted reader is left with pos == len.
+static int reader_fill(const extsort_t *sorter, reader_t *r) {
+    if (r->pos < r->len || r->left == 0) {
+        return 0;
+    }
+    size_t records = r->size / sorter->record_size;
+    if (records > r->left) {
+        records = r->left;
+    }
+    size_t want = records * sorter->record_size;
+    size_t have = 0;
+    while (have < want) {
+        ssize_t n =
+            pread(sorter->fd, r->buf + have, want - have, r->offset + have);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            if (n < 0) {
+                perror("pread");
+            } else {
+                fprintf(stderr, "extsort: run ended early\n");
+            }
+            return -1;
+        }
+        have += n;
+    }
+    r->offset += want;
+    r->left -= records;
+    r->pos = 0;
+    r->len = want;
+    return 0;
+}
+
+static const char *reader_current(const reader_t *r) { return r->buf + r->pos; }
+
+static void sift_down(const extsort_t *sorter, merger_t *m, size_t i) {
+    for (;;) {
+        size_t smallest = i, left = 2 * i + 1, right = left + 1;
+        if (left < m->heap_len &&
+            sorter->cmp(reader_current(&m->readers[m->heap[left]]),
+                        reader_current(&m->readers[m->heap[smallest]])) < 0) {
+            smallest = left;
+        }
+        if (right < m->heap_len &&
+            sorter->cmp(reader_current(&m->readers[m->heap[right]]),
+                        reader_current(&m->readers[m->heap[smallest]])) < 0) {
+            smallest = right;
+        }
+        if (smallest == i) {
+            return;
+        }
+        size_t tmp = m->heap[i];
+        m->heap[i] = m->heap[smallest];
+        m->heap[smallest] = tmp;
+        i = smallest;
+    }
+}
+
+static void merger_free(merger_t *m) {
+    free(m->readers);
+    free(m->heap);
+    free(m->buffers);
+    memset(m, 0, sizeof(merger_t));
+}
+
+// Start merging n runs, reading each through a buffer of buffer_size bytes
+static int merger_init(const extsort_t *sorter, merger_t *m, const run_t *runs,
+                       size_t n, size_t buffer_size) {
+    buffer_size -= buffer_size % sorter->record_size;
+    if (buffer_size == 0) {
+        buffer_size = sorter->record_size;
+    }
+    memset(m, 0, sizeof(merger_t));
+    m->readers = calloc(n ? n : 1, sizeof(reader_t));
+    m->heap = malloc((n ? n : 1) * sizeof(size_t));
+    m->buffers = malloc((n ? n : 1) * buffer_size);
+    if (m->readers == NULL || m->heap == NULL || m->buffers == NULL) {
+        perror("malloc");
+        merger_free(m);
+        return -1;
+    }
+    for (size_t i = 0; i < n; i++) {
+        reader_t *r = &m->readers[i];
+        r->offset = runs[i].offset;
+        r->left = runs[i].count;
+        r->buf = m->buffers + i * buffer_size;
+        r->size = buffer_size;
+        if (reader_fill(sorter, r) != 0) {
+            merger_free(m);
+            return -1;
+        }
+        if (r->len > 0) {
+            m->heap[m->heap_len++] = i;
+        }
+    }
+    for (size_t i = m->heap_len / 2; i-- > 0;) {
+        sift_down(sorter, m, i);
+    }
+    return 0;
+}
+
+// The smallest record not handed out yet. The one handed out last is only
+// stepped past now, so it stays valid until this call.
+static const void *merger_next(const extsort_t *sorter, merger_t *m,
+                               int *failed) {
+    if (m->popped && m->heap_len > 0) {
+        reader_t *r = &m->readers[m->heap[0]];
+        r->pos += sorter->record_size;
+        if (reader_fill(sorter, r) != 0) {
+            *failed = 1;
+            return NULL;
+        }
+        if (r->pos == r->len) {
+            m->heap[0] = m->heap[--m->heap_len];
+        }
+        sift_down(sorter, m, 0);
+    }
+    if (m->heap_len == 0) {
+        return NULL;
+    }
+    m->popped = 1;
+    return reader_current(&m->readers[m->heap[0]]);
+}
+
+// Merge the first n runs into one new run at the end
+static int merge_pass(extsort_t *sorter, size_t n, size_t buffer_size) {
+    size_t count = 0;
+    for (size_t i = 0; i < n; i++) {
+        count += sorter->runs[i].count;
+    }
+    merger_t m;
+    if (push_run(sorter, count) != 0 ||
+        merger_init(sorter, &m, sorter->runs, n, buffer_size) != 0) {
+        return -1;
+    }
+    off_t offset = sorter->runs[sorter->num_runs - 1].offset;
+    size_t out_size = buffer_size - buffer_size % sorter->record_size;
+    if (out_size == 0) {
+        out_size = sorter->record_size;
+    }
+    char *out = malloc(out_size);
+    if (out == NULL) {
+        perror("malloc");
+        goto fail;
+    }
+
+    size_t used = 0;
+    const void *record;
+    while ((record = merger_next(sorter, &m, &sorter->failed)) != NULL) {
+        if (used == out_size) {
+            if (write_all(sorter->fd, out, used, offset) != 0) {
+                goto fail;
+            }
+            offset += used;
+            used = 0;
+        }
+        memcpy(out + used, record, sorter->record_size);
+        used += sorter->record_size;
+    }
+    if (sorter->failed || write_all(sorter->fd, out, used, offset) != 0) {
+        goto fail;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        release_run(sorter, &sorter->runs[i]);
+    }
+    sorter->num_runs -= n;
+    memmove(sorter->runs, sorter->runs + n, sorter->num_runs * sizeof(run_t));
+    free(out);
+    merger_free(&m);
+    return 0;
+
+fail:
+    free(out);
+    merger_free(&m);
+    return -1;
+}
+
+int extsort_merge(extsort_t *sorter, size_t memory) {
+    if (sorter->failed) {
+        return -1;
+    }
+    // A pass needs a buffer per run it reads plus one for the run it writes
+    size_t fan_in = memory / MIN_RUN_BUFFER;
+    fan_in = fan_in > 3 ? fan_in - 1 : 2;
+    while (sorter->num_runs > fan_in) {
+        if (merge_pass(sorter, fan_in, memory / (fan_in + 1)) != 0) {
+            sorter->failed = 1;
+            return -1;
+        }
+    }
+
+    size_t n = sorter->num_runs;
+    if (merger_init(sorter, &sorter->merger, sorter->runs, n,
+                    memory / (n ? n : 1)) != 0) {
+        sorter->failed = 1;
+        return -1;
+    }
+    sorter->merging = 1;
+    return 0;
+}
+
+const void *extsort_next(extsort_t *sorter) {
+    if (!sorter->merging || sorter->failed) {
+        return NULL;
+    }
+    return merger_next(sorter, &sorter->merger, &sorter->failed);
+}
+
+int extsort_failed(const extsort_t *sorter) { return sorter->failed; }
+
+void extsort_destroy(extsort_t *sorter) {
+    if (sorter == NULL) {
+        return;
+    }
+    merger_free(&sorter->merger);
+    close(sorter->fd);
+    free(sorter->runs);
+    pthread_mutex_destroy(&sorter->lock);
+    free(sorter);
+}
@@ -0,0 +1,39 @@
+// Lab 7 - External merge sort of fixed-size records
+//
+// Records are handed over a sorted run at a time; the runs go one after
+// another into a single temporary file (already unlinked, so nothing is left
+// behind), so a sort holds one file open however many runs it has. Merging
+// reads all the runs at once through buffers that fit in the memory it is
+// given, merging runs into longer ones first if there are too many of them
+// for that.
+#ifndef EXTSORT_H
+#define EXTSORT_H
+
+#include <stddef.h>
+
+typedef int (*extsort_cmp_t)(const void *a, const void *b);
+
+typedef struct extsort extsort_t;
+
+// A sorter for records of record_size bytes, in cmp order. Runs go to
+// $TMPDIR, or /tmp. NULL if the file can't be made.
+extsort_t *extsort_create(size_t record_size, extsort_cmp_t cmp);
+
+// Sort the n records at records in place and write them out as a run. Can be
+// called from several threads at once.
+int extsort_add_run(extsort_t *sorter, void *records, size_t n);
+
+// Get ready to read every record back in order, with at most memory bytes of
+// buffers
+int extsort_merge(extsort_t *sorter, size_t memory);
+
+// The next record, valid until the next call; NULL after the last one or on
+// a read error
+const void *extsort_next(extsort_t *sorter);
+
+// Whether reading or writing a run has failed
+int extsort_failed(const extsort_t *sorter);
+
+void extsort_destroy(extsort_t *sorter);
+
+#endif
@@ -0,0 +1,327 @@
+// Lab 7 - Reading the input values in bulk
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ingest.h"
+
+#define READ_BUFFER_SIZE (1 << 20)
+#define MIN_VALUES_CAPACITY 1024
+
+// Parse the line at p, which ends at the next '\n' or at end. Returns 0 if
+// it doesn't start with a number; otherwise sets *value and *next to the
+// start of the following line.
+static int parse_line(const char *p, const char *end, int *value,
+                      const char **next) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\v' ||
+                       *p == '\f')) {
+        p++;
+    }
+    int negative = 0;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+    if (p == end || (unsigned char)(*p - '0') > 9) {
+        return 0;
+    }
+    uint32_t v = 0;
+    do {
+        v = v * 10 + (uint32_t)(*p++ - '0');
+    } while (p < end && (unsigned char)(*p - '0') <= 9);
+    *value = (int)(negative ? 0u - v : v);
+
+    const char *newline = memchr(p, '\n', end - p);
+    *next = newline ? newline + 1 : end;
+    return 1;
+}
+
+// Parse every line of [text, end) into values, stopping at the first that
+// isn't a number. Returns how many were parsed; *stopped tells whether a
+// line stopped it.
+static size_t parse_lines(const char *text, const char *end, int *values,
+                          int *stopped) {
+    size_t n = 0;
+    *stopped = 0;
+    while (text < end) {
+        if (!parse_line(text, end, &values[n], &text)) {
+            *stopped = 1;
+            break;
+        }
+        n++;
+    }
+    return n;
+}
+
+static size_t count_newlines(const char *text, const char *end) {
+    size_t n = 0;
+    while ((text = memchr(text, '\n', end - text)) != NULL) {
+        n++;
+        text++;
+    }
+    return n;
+}
+
+// One thread's share of a mapped file: whole lines, from begin to end
+typedef struct {
+    const char *begin;
+    const char *end;
+    int *values; // room for a value per line
+    size_t count;
+    int stopped;
+    pthread_t thread;
+} parse_chunk_t;
+
+static void *count_thread_func(void *arg) {
+    parse_chunk_t *chunk = (parse_chunk_t *)arg;
+    chunk->count = count_newlines(chunk->begin, chunk->end);
+    return NULL;
+}
+
+static void *parse_thread_func(void *arg) {
+    parse_chunk_t *chunk = (parse_chunk_t *)arg;
+    chunk->count =
+        parse_lines(chunk->begin, chunk->end, chunk->values, &chunk->stopped);
+    return NULL;
+}
+
+// Run fn on every chunk, on threads of their own if they can be had
+static void run_chunks(void *(*fn)(void *), parse_chunk_t *chunks, int n) {
+    int started = 0;
+    for (; started < n; started++) {
+        if (pthread_create(&chunks[started].thread, NULL, fn,
+                           &chunks[started]) != 0) {
+            break;
+        }
+    }
+    for (int i = started; i < n; i++) {
+        fn(&chunks[i]);
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(chunks[i].thread, NULL);
+    }
+}
+
+// Parse a whole mapped file: count the lines of each chunk to know where its
+// values go, then parse the chunks in parallel. Everything after the first
+// line that stops the input is dropped.
+static int parse_mapped(const char *text, size_t len, int num_threads,
+                        int **values, size_t *count) {
+    if (num_threads < 1) {
+        num_threads = 1;
+    }
+    parse_chunk_t *chunks = calloc(num_threads, sizeof(parse_chunk_t));
+    if (chunks == NULL) {
+        perror("calloc");
+        return -1;
+    }
+    // Chunks start right after a newline
+    const char *end = text + len;
+    const char *p = text;
+    for (int i = 0; i < num_threads; i++) {
+        chunks[i].begin = p;
+        if (i == num_threads - 1) {
+            p = end;
+        } else {
+            const char *cut = text + len / num_threads * (i + 1);
+            if (cut < p) {
+                cut = p;
+            }
+            const char *newline =
+                cut < end ? memchr(cut, '\n', end - cut) : NULL;
+            p = newline ? newline + 1 : end;
+        }
+        chunks[i].end = p;
+    }
+
+    run_chunks(count_thread_func, chunks, num_threads);
+    size_t lines = 0;
+    for (int i = 0; i < num_threads; i++) {
+        lines += chunks[i].count;
+    }
+    // The last line may have no newline
+    if (len > 0 && text[len - 1] != '\n') {
+        lines++;
+    }
+
+    *values = malloc((lines + 1) * sizeof(int));
+    if (*values == NULL) {
+        perror("malloc");
+        free(chunks);
+        return -1;
+    }
+    size_t offset = 0;
+    for (int i = 0; i < num_threads; i++) {
+        chunks[i].values = *values + offset;
+        offset += chunks[i].count;
+    }
+    run_chunks(parse_thread_func, chunks, num_threads);
+
+    *count = 0;
+    for (int i = 0; i < num_threads; i++) {
+        *count += chunks[i].count;
+        if (chunks[i].stopped) {
+            break;
+        }
+    }
+    free(chunks);
+    return 0;
+}
+
+// Make room for at least want values
+static int reserve(int **values, size_t *capacity, size_t want) {
+    if (want <= *capacity) {
+        return 0;
+    }
+    size_t grown = *capacity ? *capacity : MIN_VALUES_CAPACITY;
+    while (grown < want) {
+        grown *= 2;
+    }
+    int *p = realloc(*values, grown * sizeof(int));
+    if (p == NULL) {
+        perror("realloc");
+        return -1;
+    }
+    *values = p;
+    *capacity = grown;
+    return 0;
+}
+
+// Read and parse a buffer at a time, stopping as soon as a line stops the
+// input
+static int parse_stream(int fd, int **values, size_t *count) {
+    size_t size = READ_BUFFER_SIZE, have = 0, capacity = 0;
+    char *buffer = malloc(size);
+    *values = NULL;
+    *count = 0;
+    if (buffer == NULL) {
+        perror("malloc");
+        return -1;
+    }
+
+    int stopped = 0, eof = 0;
+    while (!stopped && !eof) {
+        if (have == size) {
+            // A line longer than the buffer
+            char *grown = realloc(buffer, size * 2);
+            if (grown == NULL) {
+                perror("realloc");
+                goto fail;
+            }
+            buffer = grown;
+            size *= 2;
+        }
+        ssize_t n = read(fd, buffer + have, size - have);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("read");
+            goto fail;
+        }
+        eof = n == 0;
+        have += n;
+
+        // Whole lines only, unless there's no more to come
+        const char *end = buffer + have;
+        if (!eof) {
+            const char *last = buffer + have;
+            while (last > buffer && last[-1] != '\n') {
+                last--;
+            }
+            end = last;
+        }
+        // Every line but the last takes at least two bytes
+        size_t len = end - buffer;
+        if (reserve(values, &capacity, *count + len / 2 + 1) != 0) {
+            goto fail;
+        }
+        *count += parse_lines(buffer, end, *values + *count, &stopped);
+        memmove(buffer, end, buffer + have - end);
+        have = buffer + have - end;
+    }
+    free(buffer);
+    return 0;
+
+fail:
+    free(buffer);
+    free(*values);
+    *values = NULL;
+    return -1;
+}
+
+int ingest_text(int fd, int num_threads, int **values, size_t *count) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+        return parse_stream(fd, values, count);
+    }
+
+    // Parse from wherever the file offset is, like read would
+    off_t start = lseek(fd, 0, SEEK_CUR);
+    if (start < 0 || start >= st.st_size) {
+        return parse_stream(fd, values, count);
+    }
+    char *text = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (text == MAP_FAILED) {
+        return parse_stream(fd, values, count);
+    }
+    madvise(text, st.st_size, MADV_SEQUENTIAL);
+    int ret = parse_mapped(text + start, st.st_size - start, num_threads,
+                           values, count);
+    munmap(text, st.st_size);
+    return ret;
+}
+
+int ingest_binary(int fd, int **values, size_t *count) {
+    struct stat st;
+    size_t size = READ_BUFFER_SIZE, have = 0;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        size = st.st_size + 1; // one more, to see the end of file
+    }
+    char *data = malloc(size);
+    if (data == NULL) {
+        perror("malloc");
+        return -1;
+    }
+    for (;;) {
+        if (have == size) {
+            char *grown = realloc(data, size * 2);
+            if (grown == NULL) {
+                perror("realloc");
+                free(data);
+                return -1;
+            }
+            data = grown;
+            size *= 2;
+        }
+        ssize_t n = read(fd, data + have, size - have);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            perror("read");
+            free(data);
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        have += n;
+    }
+    if (have % sizeof(int) != 0) {
+        fprintf(stderr, "ingest_binary: %zu bytes is not a whole number of "
+                        "32-bit values\n",
+                have);
+        free(data);
+        return -1;
+    }
+    *values = (int *)data;
+    *count = have / sizeof(int);
+    return 0;
+}
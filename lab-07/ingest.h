@@ -0,0 +1,21 @@
+// Lab 7 - Reading the input values in bulk
+#ifndef INGEST_H
+#define INGEST_H
+
+#include <stddef.h>
+
+// Read integers, one per line, from fd into a malloc'd array, the way the lab
+// reads them with fgets and sscanf("%d"): leading blanks and a sign are
+// allowed, anything after the number is ignored, and the first line that
+// doesn't start with a number (such as "end") ends the input. Values out of
+// int range wrap around.
+//
+// A regular file is mapped and parsed by num_threads threads. Anything else
+// is read a buffer at a time, so typing "end" at a terminal still ends the
+// input. Returns -1 on failure.
+int ingest_text(int fd, int num_threads, int **values, size_t *count);
+
+// Read native-endian 32-bit integers back to back until end of file
+int ingest_binary(int fd, int **values, size_t *count);
+
+#endif
@@ -1,8 +1,17 @@
 
+#include <getopt.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
-#define MAX_INPUT 100
+#include "extsort.h"
+#include "ingest.h"
+#include "mapreduce.h"
+
+#define NUM_THREADS 4
+#define MIN_SPILL_MEMORY_MIB 1
 
 typedef struct {
     int line_number;
@@ -14,62 +23,124 @@ typedef struct{
     int doubled_value;
 } IntermediateInput;
 
+// A group as the runtime hands it back: the key comes out of its key
+// column, and line_numbers points at the group's postings in the value
+// column, where every group's line numbers sit one group after another
 typedef struct {
     int doubled_value;
-    int line_numbers[MAX_INPUT];
-    int count;
+    int *line_numbers;
+    size_t count;
 } Output;
 
+// A mapped pair tagged with the first line of its key, so that sorting by
+// first_line, then line_number, lays the groups out in output order
+typedef struct {
+    int first_line;
+    int line_number;
+    int doubled_value;
+} GroupedLine;
+
 void map(Input* input, IntermediateInput* intermediate_input);
 void groupByKey(IntermediateInput* input, Output *output, int *result_count);
 void reduce(Output* output);
+static void printLineNumbers(const int *line_numbers, size_t count,
+                             int continued);
 
-int main() {
-    Input input_data[MAX_INPUT];
-    int input_size = 0;
-    int value;
+// The runtime's callbacks around map and reduce
+static void mapRecord(const void *record, size_t index, mr_emitter_t *out,
+                      void *arg);
+static void groupLines(const mr_bytes_t *key, const mr_values_t *values,
+                       mr_emitter_t *out, void *arg);
 
-    // Read input values until "end" is encountered
-    printf("Enter values (one per line). Type 'end' to finish:\n");
-    while (input_size < MAX_INPUT) {
-        char buffer[100];
-        if (fgets(buffer, sizeof(buffer), stdin) == NULL) {
-            break;
-        }
-        if (sscanf(buffer, "%d", &value) == 1) {
-            input_data[input_size].line_number = input_size + 1;
-            input_data[input_size].value = value;
-            input_size++;
-        } else if (sscanf(buffer, "end") == 0) {
-            break;
+// The same steps out of core, for groups that don't fit in memory: the map
+// phase writes sorted runs of pairs to temporary files, and the groups are
+// merged back out of them, using at most memory bytes of buffers per step
+static extsort_t *spillPairs(const int *values, size_t count, size_t memory);
+static extsort_t *groupSpilled(extsort_t *pairs, size_t memory);
+static int reduceSpilled(extsort_t *groups, size_t memory);
+
+int main(int argc, char *argv[]) {
+    int binary = 0;
+    size_t spill_memory = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "bm:")) != -1) {
+        char *end;
+        if (opt == 'b') {
+            binary = 1;
+        } else if (opt == 'm' &&
+                   (spill_memory = strtoul(optarg, &end, 10)) >=
+                       MIN_SPILL_MEMORY_MIB &&
+                   *end == '\0') {
+            spill_memory <<= 20;
         } else {
-            printf("Invalid input. Please enter an integer or 'end' to finish.\n");
+            fprintf(stderr, "Usage: %s [-b] [-m MiB] < input\n"
+                            "  -b  read native 32-bit integers instead of "
+                            "text, one value per line number\n"
+                            "  -m  group through temporary files, with at "
+                            "most MiB of buffers\n",
+                    argv[0]);
+            return 1;
         }
     }
 
-    // Step 1: Map phase
-    
-    IntermediateInput mapped_results[MAX_INPUT] = {0};
+    // Read input values until "end" is encountered. The values themselves
+    // are the input records; a value's line number is its index + 1.
+    int *input_values;
+    size_t input_size;
+    int ret;
+    if (binary) {
+        ret = ingest_binary(STDIN_FILENO, &input_values, &input_size);
+    } else {
+        printf("Enter values (one per line). Type 'end' to finish:\n");
+        fflush(stdout);
+        ret = ingest_text(STDIN_FILENO, NUM_THREADS, &input_values,
+                          &input_size);
+    }
+    if (ret != 0) {
+        return 1;
+    }
 
-    for (int i = 0; i < input_size; i++) {
-        map(&input_data[i], &mapped_results[i]);
+    if (spill_memory > 0) {
+        // Step 1: Map phase, into sorted runs by doubled value
+        extsort_t *pairs = spillPairs(input_values, input_size, spill_memory);
+        free(input_values);
+        // Step 2: Grouping phase, re-sorted into output order
+        extsort_t *groups =
+            pairs ? groupSpilled(pairs, spill_memory) : NULL;
+        // Step 3: Reduce phase
+        return groups ? reduceSpilled(groups, spill_memory) : 1;
     }
 
+    // Step 1: Map phase
     // Step 2: Grouping phase
-    
-    Output output_results[MAX_INPUT] = {0};
-    int result_count = 0;
-
-    for (int i = 0; i < input_size; i++) {
-        groupByKey(&mapped_results[i], output_results, &result_count);
+    // Both run in the MapReduce runtime: mapRecord maps every input, and
+    // groupLines has groupByKey collect each key's line numbers. The groups
+    // come back in the order their keys first appear.
+    mr_job_t job = {
+        .map = mapRecord,
+        .reduce = groupLines,
+        .arg = NULL,
+        .num_threads = NUM_THREADS,
+    };
+    mr_result_t result;
+    ret = mr_run(&job, input_values, input_size, sizeof(int), &result);
+    free(input_values);
+    if (ret != 0) {
+        return 1;
     }
 
     // Step 3: Reduce phase
-    for (int i = 0; i < result_count; i++) {
-        if (output_results[i].count > 0) {
-            reduce(&output_results[i]);
+    for (size_t i = 0; i < result.num_pairs; i++) {
+        mr_bytes_t key = mr_result_key(&result, i);
+        mr_bytes_t lines = mr_result_value(&result, i);
+        Output output = {.line_numbers = (int *)lines.data,
+                         .count = lines.len / sizeof(int)};
+        memcpy(&output.doubled_value, key.data, sizeof(int));
+        if (output.count > 0) {
+            reduce(&output);
         }
     }
+    mr_result_free(&result);
 
     return 0;
 }
@@ -83,9 +154,21 @@ void map(Input* input, IntermediateInput *intermediate_input) {
     intermediate_input->doubled_value = input->value * 2;
 }
 
+static void mapRecord(const void *record, size_t index, mr_emitter_t *out,
+                      void *arg) {
+    (void)arg;
+    Input input = {.line_number = (int)index + 1,
+                   .value = *(const int *)record};
+    IntermediateInput mapped;
+    map(&input, &mapped);
+    mr_emit(out, &mapped.doubled_value, sizeof(int), &mapped.line_number,
+            sizeof(int));
+}
+
 void groupByKey(IntermediateInput* input, Output *output, int *result_count){
     // Group entries by doubled_value. If an entry exists, append the line number,
-    // otherwise create a new Output entry.
+    // otherwise create a new Output entry. Each entry's line_numbers must have
+    // room for every line of its key.
     if (input == NULL || output == NULL || result_count == NULL) {
         return;
     }
@@ -95,10 +178,8 @@ void groupByKey(IntermediateInput* input, Output *output, int *result_count){
     // Search for existing key
     for (int i = 0; i < *result_count; i++) {
         if (output[i].doubled_value == key) {
-            if (output[i].count < MAX_INPUT) {
-                output[i].line_numbers[output[i].count] = input->line_number;
-                output[i].count++;
-            }
+            output[i].line_numbers[output[i].count] = input->line_number;
+            output[i].count++;
             return;
         }
     }
@@ -106,22 +187,213 @@ void groupByKey(IntermediateInput* input, Output *output, int *result_count){
     // Not found: create new entry
     int idx = *result_count;
     output[idx].doubled_value = key;
-    output[idx].count = 0;
-    if (output[idx].count < MAX_INPUT) {
-        output[idx].line_numbers[output[idx].count] = input->line_number;
-        output[idx].count = 1;
-    }
+    output[idx].line_numbers[0] = input->line_number;
+    output[idx].count = 1;
     (*result_count)++;
 }
 
+static void groupLines(const mr_bytes_t *key, const mr_values_t *values,
+                       mr_emitter_t *out, void *arg) {
+    // The runtime hands over one key's records at a time, so groupByKey only
+    // has the one group to look through
+    (void)arg;
+    Output output = {.line_numbers =
+                         mr_scratch(out, values->count * sizeof(int))};
+    int result_count = 0;
+    if (output.line_numbers == NULL) {
+        return;
+    }
+    IntermediateInput mapped;
+    memcpy(&mapped.doubled_value, key->data, sizeof(int));
+    for (size_t i = 0; i < values->count; i++) {
+        memcpy(&mapped.line_number, values->items[i].data, sizeof(int));
+        groupByKey(&mapped, &output, &result_count);
+    }
+    mr_emit(out, key->data, key->len, output.line_numbers,
+            output.count * sizeof(int));
+}
+
+static int compareByKey(const void *a, const void *b) {
+    const IntermediateInput *x = a, *y = b;
+    if (x->doubled_value != y->doubled_value) {
+        return x->doubled_value < y->doubled_value ? -1 : 1;
+    }
+    return (x->line_number > y->line_number) -
+           (x->line_number < y->line_number);
+}
+
+static int compareByFirstLine(const void *a, const void *b) {
+    const GroupedLine *x = a, *y = b;
+    if (x->first_line != y->first_line) {
+        return x->first_line < y->first_line ? -1 : 1;
+    }
+    return (x->line_number > y->line_number) -
+           (x->line_number < y->line_number);
+}
+
+// One mapper's slice of the input, spilled a bufferful at a time
+typedef struct {
+    const int *values;
+    size_t begin;
+    size_t end;
+    size_t capacity; // pairs per run
+    extsort_t *sorter;
+    int failed;
+    pthread_t thread;
+} SpillTask;
+
+static void *spillThread(void *arg) {
+    SpillTask *task = (SpillTask *)arg;
+    IntermediateInput *pairs =
+        malloc(task->capacity * sizeof(IntermediateInput));
+    if (pairs == NULL) {
+        perror("malloc");
+        task->failed = 1;
+        return NULL;
+    }
+    size_t n = 0;
+    for (size_t i = task->begin; i < task->end && !task->failed; i++) {
+        Input input = {.line_number = (int)i + 1, .value = task->values[i]};
+        map(&input, &pairs[n++]);
+        if (n == task->capacity) {
+            task->failed = extsort_add_run(task->sorter, pairs, n) != 0;
+            n = 0;
+        }
+    }
+    if (!task->failed) {
+        task->failed = extsort_add_run(task->sorter, pairs, n) != 0;
+    }
+    free(pairs);
+    return NULL;
+}
+
+static extsort_t *spillPairs(const int *values, size_t count, size_t memory) {
+    extsort_t *pairs = extsort_create(sizeof(IntermediateInput), compareByKey);
+    if (pairs == NULL) {
+        return NULL;
+    }
+    // Every mapper sorts its own share of the memory
+    SpillTask tasks[NUM_THREADS];
+    int started = 0, failed = 0;
+    for (int t = 0; t < NUM_THREADS; t++) {
+        tasks[t] = (SpillTask){
+            .values = values,
+            .begin = count / NUM_THREADS * t,
+            .end = t == NUM_THREADS - 1 ? count : count / NUM_THREADS * (t + 1),
+            .capacity = memory / NUM_THREADS / sizeof(IntermediateInput),
+            .sorter = pairs,
+        };
+    }
+    for (; started < NUM_THREADS; started++) {
+        if (pthread_create(&tasks[started].thread, NULL, spillThread,
+                           &tasks[started]) != 0) {
+            break;
+        }
+    }
+    for (int t = started; t < NUM_THREADS; t++) {
+        spillThread(&tasks[t]);
+    }
+    for (int t = 0; t < NUM_THREADS; t++) {
+        if (t < started) {
+            pthread_join(tasks[t].thread, NULL);
+        }
+        failed |= tasks[t].failed;
+    }
+    if (failed) {
+        extsort_destroy(pairs);
+        return NULL;
+    }
+    return pairs;
+}
+
+static extsort_t *groupSpilled(extsort_t *pairs, size_t memory) {
+    // Half the memory merges the pairs by key, so every key's first line
+    // comes first; the other half sorts them again by that line
+    extsort_t *groups = extsort_create(sizeof(GroupedLine), compareByFirstLine);
+    size_t capacity = memory / 2 / sizeof(GroupedLine);
+    GroupedLine *buffer = malloc(capacity * sizeof(GroupedLine));
+    if (groups == NULL || buffer == NULL || extsort_merge(pairs, memory / 2)) {
+        if (buffer == NULL) {
+            perror("malloc");
+        }
+        goto fail;
+    }
+
+    const IntermediateInput *pair;
+    size_t n = 0;
+    int started = 0, key = 0, first_line = 0;
+    while ((pair = extsort_next(pairs)) != NULL) {
+        if (!started || pair->doubled_value != key) {
+            started = 1;
+            key = pair->doubled_value;
+            first_line = pair->line_number;
+        }
+        buffer[n++] = (GroupedLine){first_line, pair->line_number, key};
+        if (n == capacity) {
+            if (extsort_add_run(groups, buffer, n) != 0) {
+                goto fail;
+            }
+            n = 0;
+        }
+    }
+    if (extsort_failed(pairs) || extsort_add_run(groups, buffer, n) != 0) {
+        goto fail;
+    }
+    free(buffer);
+    extsort_destroy(pairs);
+    return groups;
+
+fail:
+    free(buffer);
+    extsort_destroy(pairs);
+    extsort_destroy(groups);
+    return NULL;
+}
+
+
+static int reduceSpilled(extsort_t *groups, size_t memory) {
+    // Each group's lines are printed as they stream past, so a group never
+    // has to fit in memory
+    int ret = extsort_merge(groups, memory);
+    const GroupedLine *line;
+    int started = 0, first_line = 0;
+    while (ret == 0 && (line = extsort_next(groups)) != NULL) {
+        int continued = started && line->first_line == first_line;
+        if (!continued) {
+            if (started) {
+                printf("])\n");
+            }
+            started = 1;
+            first_line = line->first_line;
+            printf("(%d, [", line->doubled_value);
+        }
+        printLineNumbers(&line->line_number, 1, continued);
+    }
+    if (started) {
+        printf("])\n");
+    }
+    if (extsort_failed(groups)) {
+        ret = -1;
+    }
+    extsort_destroy(groups);
+    return ret == 0 ? 0 : 1;
+}
+
 void reduce(Output* output) {
     if (output == NULL) return;
 
     // Print in the format: (doubled, [l1, l2, l3])
     printf("(%d, [", output->doubled_value);
-    for (int i = 0; i < output->count; i++) {
-        if (i > 0) printf(", ");
-        printf("%d", output->line_numbers[i]);
-    }
+    printLineNumbers(output->line_numbers, output->count, 0);
     printf("])\n");
-}
\ No newline at end of file
+}
+
+// Print line numbers into a group's list; continued says whether some came
+// before them
+static void printLineNumbers(const int *line_numbers, size_t count,
+                             int continued) {
+    for (size_t i = 0; i < count; i++) {
+        if (i > 0 || continued) printf(", ");
+        printf("%d", line_numbers[i]);
+    }
+}
@@ -0,0 +1,765 @@
+// Lab 7 - A small multi-threaded MapReduce runtime
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "mapreduce.h"
+
+#define ARENA_MIN_BLOCK 4096
+#define ARENA_MAX_BLOCK (1 << 20)
+#define RECORD_ALIGN 4
+#define GROUPS_MIN_CAPACITY 64
+#define KEYS_MIN_CAPACITY 1024
+#define NO_GROUP UINT32_MAX
+
+// Arena blocks are chained oldest first, so records read back in the order
+// they were appended. A block's records count their input indexes from its
+// base; a record too far past it starts a new block.
+typedef struct mr_block {
+    struct mr_block *next;
+    size_t used;
+    size_t size;
+    size_t base;
+    _Alignas(RECORD_ALIGN) char data[];
+} mr_block_t;
+
+typedef struct {
+    mr_block_t *head;
+    mr_block_t *tail;
+    size_t count; // records appended
+    size_t key_bytes; // their keys' and values' lengths added up
+    size_t value_bytes;
+} mr_arena_t;
+
+// One emitted pair. Its index, the input record it was mapped from or, for
+// reduce output, the first input record of its key, is its block's base
+// plus index_offset.
+typedef struct {
+    uint32_t index_offset;
+    uint32_t hash;
+    uint32_t key_len;
+    uint32_t value_len;
+    char data[]; // the key, then the value
+} mr_record_t;
+
+// A distinct key of a partition, and where its values go in the partition's
+// postings. The key is copied out, so that the records can be freed as their
+// values are scattered.
+//
+// value_end and byte_end first count the key's values and their bytes, then
+// become where the next value goes, and end up where the key's values end.
+// Groups are laid out in order, so each one's values start where the
+// previous one's end.
+typedef struct {
+    size_t first_index; // of the key's first record
+    size_t key_offset;  // in the partition's key bytes
+    uint32_t key_len;
+    uint32_t hash;
+    size_t value_end;
+    size_t byte_end;
+} mr_group_t;
+
+// A slot of a partition's key table; group is NO_GROUP while it's empty.
+// The hash sits next to it so that other keys are passed over without
+// touching their bytes.
+typedef struct {
+    uint32_t hash;
+    uint32_t group;
+} mr_slot_t;
+
+typedef struct {
+    const mr_job_t *job;
+    const char *records;
+    size_t num_records;
+    size_t record_size;
+    int num_threads;
+
+    // mapped[t * num_threads + p]: what worker t mapped to partition p.
+    // reduced[p]: the reduce output of partition p.
+    mr_arena_t *mapped;
+    mr_arena_t *reduced;
+    size_t *num_groups;
+
+    // Workers wait at the gate until all of them have been started, so no
+    // one is left waiting at a barrier for a thread that never came
+    pthread_mutex_t gate_lock;
+    pthread_cond_t gate;
+    int gate_open;
+    pthread_barrier_t barrier;
+    atomic_int failed;
+
+    double start;
+    double map_done;
+    double group_done;
+} mr_runtime_t;
+
+struct mr_emitter {
+    mr_runtime_t *rt;
+    mr_arena_t *arenas; // one per partition, or just the one for output
+    int num_arenas;
+    size_t index;
+    char *scratch; // see mr_scratch
+    size_t scratch_size;
+};
+
+typedef struct {
+    mr_runtime_t *rt;
+    int id;
+    pthread_t thread;
+} mr_worker_t;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static size_t record_size(size_t key_len, size_t value_len) {
+    size_t size = sizeof(mr_record_t) + key_len + value_len;
+    return (size + RECORD_ALIGN - 1) & ~(size_t)(RECORD_ALIGN - 1);
+}
+
+static const mr_record_t *next_record(const mr_record_t *record) {
+    return (const mr_record_t *)((const char *)record +
+                                 record_size(record->key_len,
+                                             record->value_len));
+}
+
+// A record of size bytes for input record index at the end of arena, NULL
+// if out of memory
+static mr_record_t *arena_append(mr_arena_t *arena, size_t size,
+                                 size_t index) {
+    mr_block_t *block = arena->tail;
+    if (block == NULL || block->size - block->used < size ||
+        index < block->base || index - block->base > UINT32_MAX) {
+        size_t block_size = block ? block->size * 2 : ARENA_MIN_BLOCK;
+        if (block_size > ARENA_MAX_BLOCK) {
+            block_size = ARENA_MAX_BLOCK;
+        }
+        if (block_size < size) {
+            block_size = size;
+        }
+        block = malloc(sizeof(mr_block_t) + block_size);
+        if (block == NULL) {
+            return NULL;
+        }
+        block->next = NULL;
+        block->used = 0;
+        block->size = block_size;
+        block->base = index;
+        if (arena->tail) {
+            arena->tail->next = block;
+        } else {
+            arena->head = block;
+        }
+        arena->tail = block;
+    }
+    mr_record_t *record = (mr_record_t *)(block->data + block->used);
+    block->used += size;
+    arena->count++;
+    record->index_offset = (uint32_t)(index - block->base);
+    return record;
+}
+
+static void arena_free(mr_arena_t *arena) {
+    mr_block_t *block = arena->head;
+    while (block) {
+        mr_block_t *next = block->next;
+        free(block);
+        block = next;
+    }
+    *arena = (mr_arena_t){0};
+}
+
+// Walks an arena's records in order
+typedef struct {
+    const mr_block_t *block;
+    const mr_record_t *record;
+} mr_cursor_t;
+
+static mr_cursor_t cursor_start(const mr_arena_t *arena) {
+    mr_cursor_t cursor = {arena->head, NULL};
+    while (cursor.block && cursor.block->used == 0) {
+        cursor.block = cursor.block->next;
+    }
+    if (cursor.block) {
+        cursor.record = (const mr_record_t *)cursor.block->data;
+    }
+    return cursor;
+}
+
+static size_t cursor_index(const mr_cursor_t *cursor) {
+    return cursor->block->base + cursor->record->index_offset;
+}
+
+static void cursor_next(mr_cursor_t *cursor) {
+    const mr_record_t *next = next_record(cursor->record);
+    if ((const char *)next < cursor->block->data + cursor->block->used) {
+        cursor->record = next;
+        return;
+    }
+    do {
+        cursor->block = cursor->block->next;
+    } while (cursor->block && cursor->block->used == 0);
+    cursor->record =
+        cursor->block ? (const mr_record_t *)cursor->block->data : NULL;
+}
+
+// FNV-1a, then a final mix so that every bit depends on every byte: the
+// high bits pick the partition, the low ones the table slot
+static uint32_t hash_bytes(const void *data, size_t len) {
+    const unsigned char *p = data;
+    uint64_t h = 14695981039346656037ull;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ p[i]) * 1099511628211ull;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    return (uint32_t)(h >> 32);
+}
+
+static int partition_of(uint32_t hash, int num_partitions) {
+    return (int)(((uint64_t)hash * (uint64_t)num_partitions) >> 32);
+}
+
+void mr_emit(mr_emitter_t *out, const void *key, size_t key_len,
+             const void *value, size_t value_len) {
+    mr_runtime_t *rt = out->rt;
+    if (atomic_load_explicit(&rt->failed, memory_order_relaxed)) {
+        return;
+    }
+    if (key_len > UINT32_MAX || value_len > UINT32_MAX) {
+        fprintf(stderr, "mr_emit: a key or value is over 4 GiB\n");
+        atomic_store(&rt->failed, 1);
+        return;
+    }
+    uint32_t hash = hash_bytes(key, key_len);
+    int p = out->num_arenas > 1 ? partition_of(hash, out->num_arenas) : 0;
+    mr_arena_t *arena = &out->arenas[p];
+    mr_record_t *record =
+        arena_append(arena, record_size(key_len, value_len), out->index);
+    if (record == NULL) {
+        atomic_store(&rt->failed, 1);
+        return;
+    }
+    arena->key_bytes += key_len;
+    arena->value_bytes += value_len;
+    record->hash = hash;
+    record->key_len = (uint32_t)key_len;
+    record->value_len = (uint32_t)value_len;
+    if (key_len) {
+        memcpy(record->data, key, key_len);
+    }
+    if (value_len) {
+        memcpy(record->data + key_len, value, value_len);
+    }
+}
+
+void mr_emit_concat(mr_emitter_t *out, const mr_bytes_t *key,
+                    const mr_values_t *values) {
+    size_t len = 0;
+    for (size_t i = 0; i < values->count; i++) {
+        len += values->items[i].len;
+    }
+    char *value = mr_scratch(out, len);
+    if (value == NULL) {
+        return;
+    }
+    size_t used = 0;
+    for (size_t i = 0; i < values->count; i++) {
+        if (values->items[i].len) {
+            memcpy(value + used, values->items[i].data, values->items[i].len);
+            used += values->items[i].len;
+        }
+    }
+    mr_emit(out, key->data, key->len, value, len);
+}
+
+void *mr_scratch(mr_emitter_t *out, size_t size) {
+    if (size > out->scratch_size || out->scratch == NULL) {
+        size_t grown = out->scratch_size ? out->scratch_size : 256;
+        while (grown < size) {
+            grown *= 2;
+        }
+        char *p = realloc(out->scratch, grown);
+        if (p == NULL) {
+            atomic_store(&out->rt->failed, 1);
+            return NULL;
+        }
+        out->scratch = p;
+        out->scratch_size = grown;
+    }
+    return out->scratch;
+}
+
+static void map_slice(mr_runtime_t *rt, int id) {
+    size_t begin = rt->num_records * id / rt->num_threads;
+    size_t end = rt->num_records * (id + 1) / rt->num_threads;
+    mr_emitter_t out = {rt, rt->mapped + (size_t)id * rt->num_threads,
+                        rt->num_threads, 0, NULL, 0};
+    for (size_t i = begin; i < end; i++) {
+        out.index = i;
+        rt->job->map(rt->records + i * rt->record_size, i, &out,
+                     rt->job->arg);
+    }
+    free(out.scratch);
+}
+
+// A partition's distinct keys, with their bytes back to back
+typedef struct {
+    mr_group_t *groups;
+    size_t num_groups;
+    size_t capacity;
+    char *keys;
+    size_t keys_used;
+    size_t keys_capacity;
+} mr_grouping_t;
+
+// The slot of record's key in table, or the empty slot where it would go
+static size_t find_slot(const mr_slot_t *table, size_t mask,
+                        const mr_grouping_t *grouping,
+                        const mr_record_t *record) {
+    size_t pos = record->hash & mask;
+    for (; table[pos].group != NO_GROUP; pos = (pos + 1) & mask) {
+        if (table[pos].hash != record->hash) {
+            continue;
+        }
+        const mr_group_t *group = &grouping->groups[table[pos].group];
+        if (group->key_len == record->key_len &&
+            memcmp(grouping->keys + group->key_offset, record->data,
+                   record->key_len) == 0) {
+            break;
+        }
+    }
+    return pos;
+}
+
+// A table of mask + 1 slots holding every group so far
+static mr_slot_t *make_table(size_t mask, const mr_grouping_t *grouping) {
+    mr_slot_t *table = malloc((mask + 1) * sizeof(mr_slot_t));
+    if (table == NULL) {
+        return NULL;
+    }
+    for (size_t i = 0; i <= mask; i++) {
+        table[i].group = NO_GROUP;
+    }
+    for (size_t g = 0; g < grouping->num_groups; g++) {
+        uint32_t hash = grouping->groups[g].hash;
+        size_t pos = hash & mask;
+        while (table[pos].group != NO_GROUP) {
+            pos = (pos + 1) & mask;
+        }
+        table[pos] = (mr_slot_t){hash, (uint32_t)g};
+    }
+    return table;
+}
+
+// Start a group for record's key. Returns -1 if out of memory.
+static int add_group(mr_grouping_t *grouping, const mr_record_t *record,
+                     size_t index) {
+    if (grouping->keys_capacity - grouping->keys_used < record->key_len) {
+        size_t capacity = grouping->keys_capacity ? grouping->keys_capacity
+                                                  : KEYS_MIN_CAPACITY;
+        while (capacity - grouping->keys_used < record->key_len) {
+            capacity *= 2;
+        }
+        char *keys = realloc(grouping->keys, capacity);
+        if (keys == NULL) {
+            return -1;
+        }
+        grouping->keys = keys;
+        grouping->keys_capacity = capacity;
+    }
+    if (record->key_len) {
+        memcpy(grouping->keys + grouping->keys_used, record->data,
+               record->key_len);
+    }
+    grouping->groups[grouping->num_groups++] = (mr_group_t){
+        .first_index = index,
+        .key_offset = grouping->keys_used,
+        .key_len = record->key_len,
+        .hash = record->hash,
+    };
+    grouping->keys_used += record->key_len;
+    return 0;
+}
+
+// Group partition p and reduce it, in three passes over its records: count
+// how many values (and bytes of them) each key has, turn those counts into
+// every group's starting position with a prefix sum so the groups lie one
+// after another, then scatter each value to the next free place in its
+// group. Every worker's records for p are read in worker order, which is
+// input order, so groups come out in the order of their first records and
+// values in input order.
+static void group_and_reduce(mr_runtime_t *rt, int p) {
+    int num_threads = rt->num_threads;
+    mr_grouping_t grouping = {0};
+    mr_slot_t *table = NULL;
+    uint32_t *group_of = NULL;
+    char *postings = NULL;
+    uint32_t *value_lens = NULL;
+    mr_bytes_t *items = NULL;
+    if (atomic_load(&rt->failed)) {
+        goto fail;
+    }
+
+    size_t n = 0, value_bytes = 0;
+    for (int t = 0; t < num_threads; t++) {
+        n += rt->mapped[(size_t)t * num_threads + p].count;
+        value_bytes += rt->mapped[(size_t)t * num_threads + p].value_bytes;
+    }
+
+    group_of = malloc((n + 1) * sizeof(uint32_t));
+    if (group_of == NULL) {
+        goto fail;
+    }
+
+    // Count: find every record's group, adding up each group's values. When
+    // all the values are as long as the first, their lengths aren't kept.
+    size_t mask = 0, i = 0, max_count = 0;
+    size_t fixed_len = SIZE_MAX;
+    for (int t = 0; t < num_threads; t++) {
+        const mr_arena_t *arena = &rt->mapped[(size_t)t * num_threads + p];
+        for (mr_cursor_t c = cursor_start(arena); c.record;
+             cursor_next(&c), i++) {
+            const mr_record_t *record = c.record;
+            size_t pos = table ? find_slot(table, mask, &grouping, record) : 0;
+            if (table == NULL || table[pos].group == NO_GROUP) {
+                if (grouping.num_groups == NO_GROUP) {
+                    fprintf(stderr, "mr_run: over %u keys in a partition\n",
+                            (unsigned)NO_GROUP);
+                    goto fail;
+                }
+                if (grouping.num_groups == grouping.capacity) {
+                    // The table stays at most half full
+                    size_t capacity = grouping.capacity
+                                          ? grouping.capacity * 2
+                                          : GROUPS_MIN_CAPACITY;
+                    mr_group_t *grown = realloc(
+                        grouping.groups, capacity * sizeof(mr_group_t));
+                    if (grown == NULL) {
+                        goto fail;
+                    }
+                    grouping.groups = grown;
+                    grouping.capacity = capacity;
+                    free(table);
+                    mask = 2 * capacity - 1;
+                    table = make_table(mask, &grouping);
+                    if (table == NULL) {
+                        goto fail;
+                    }
+                    pos = find_slot(table, mask, &grouping, record);
+                }
+                table[pos] = (mr_slot_t){record->hash,
+                                         (uint32_t)grouping.num_groups};
+                if (add_group(&grouping, record, cursor_index(&c)) != 0) {
+                    goto fail;
+                }
+            }
+            mr_group_t *group = &grouping.groups[table[pos].group];
+            group_of[i] = table[pos].group;
+            group->value_end++;
+            group->byte_end += record->value_len;
+            if (group->value_end > max_count) {
+                max_count = group->value_end;
+            }
+            if (i == 0) {
+                fixed_len = record->value_len;
+            } else if (fixed_len != record->value_len) {
+                fixed_len = SIZE_MAX;
+            }
+        }
+    }
+    free(table);
+    table = NULL;
+
+    // Prefix: every group's values start where the previous group's end
+    mr_group_t *groups = grouping.groups;
+    size_t num_groups = grouping.num_groups;
+    size_t values_before = 0, bytes_before = 0;
+    for (size_t g = 0; g < num_groups; g++) {
+        size_t count = groups[g].value_end, bytes = groups[g].byte_end;
+        groups[g].value_end = values_before;
+        groups[g].byte_end = bytes_before;
+        values_before += count;
+        bytes_before += bytes;
+    }
+
+    // Scatter: copy the values into their groups' places, freeing every
+    // block of records once it's been read
+    postings = malloc(value_bytes + 1);
+    if (fixed_len == SIZE_MAX) {
+        value_lens = malloc((n + 1) * sizeof(uint32_t));
+    }
+    items = malloc((max_count + 1) * sizeof(mr_bytes_t));
+    if (postings == NULL || (fixed_len == SIZE_MAX && value_lens == NULL) ||
+        items == NULL) {
+        goto fail;
+    }
+    i = 0;
+    for (int t = 0; t < num_threads; t++) {
+        mr_arena_t *arena = &rt->mapped[(size_t)t * num_threads + p];
+        mr_block_t *block = arena->head;
+        while (block) {
+            const char *end = block->data + block->used;
+            for (const mr_record_t *record = (const mr_record_t *)block->data;
+                 (const char *)record < end;
+                 record = next_record(record), i++) {
+                mr_group_t *group = &groups[group_of[i]];
+                uint32_t len = record->value_len;
+                if (len) {
+                    memcpy(postings + group->byte_end,
+                           record->data + record->key_len, len);
+                }
+                if (value_lens) {
+                    value_lens[group->value_end] = len;
+                }
+                group->value_end++;
+                group->byte_end += len;
+            }
+            mr_block_t *next = block->next;
+            free(block);
+            block = next;
+        }
+        *arena = (mr_arena_t){0};
+    }
+    free(group_of);
+    group_of = NULL;
+    rt->num_groups[p] = num_groups;
+
+    pthread_barrier_wait(&rt->barrier);
+    if (p == 0) {
+        rt->group_done = now_sec();
+    }
+
+    mr_emitter_t out = {rt, &rt->reduced[p], 1, 0, NULL, 0};
+    size_t next_value = 0;
+    const char *value = postings;
+    for (size_t g = 0; g < num_groups; g++) {
+        const mr_group_t *group = &groups[g];
+        size_t count = group->value_end - next_value;
+        for (size_t k = 0; k < count; k++, next_value++) {
+            size_t len = value_lens ? value_lens[next_value] : fixed_len;
+            items[k] = (mr_bytes_t){value, len};
+            value += len;
+        }
+        mr_bytes_t key = {grouping.keys + group->key_offset, group->key_len};
+        mr_values_t group_values = {count, items};
+        out.index = group->first_index;
+        rt->job->reduce(&key, &group_values, &out, rt->job->arg);
+    }
+    free(out.scratch);
+    free(items);
+    free(value_lens);
+    free(postings);
+    free(grouping.keys);
+    free(grouping.groups);
+    return;
+
+fail:
+    atomic_store(&rt->failed, 1);
+    free(table);
+    free(group_of);
+    free(items);
+    free(value_lens);
+    free(postings);
+    free(grouping.keys);
+    free(grouping.groups);
+    pthread_barrier_wait(&rt->barrier);
+}
+
+static void *worker_thread_func(void *arg) {
+    mr_worker_t *worker = (mr_worker_t *)arg;
+    mr_runtime_t *rt = worker->rt;
+
+    pthread_mutex_lock(&rt->gate_lock);
+    while (!rt->gate_open) {
+        pthread_cond_wait(&rt->gate, &rt->gate_lock);
+    }
+    pthread_mutex_unlock(&rt->gate_lock);
+    if (atomic_load(&rt->failed)) {
+        return NULL;
+    }
+
+    map_slice(rt, worker->id);
+    pthread_barrier_wait(&rt->barrier);
+    if (worker->id == 0) {
+        rt->map_done = now_sec();
+    }
+    // Waits at the barrier between grouping and reducing, failed or not
+    group_and_reduce(rt, worker->id);
+    return NULL;
+}
+
+// Restore a heap of cursors, smallest index on top, below heap[i]
+static void sift_down(mr_cursor_t *heap, int n, int i) {
+    for (;;) {
+        int min = i, l = 2 * i + 1, r = 2 * i + 2;
+        if (l < n && cursor_index(&heap[l]) < cursor_index(&heap[min])) {
+            min = l;
+        }
+        if (r < n && cursor_index(&heap[r]) < cursor_index(&heap[min])) {
+            min = r;
+        }
+        if (min == i) {
+            return;
+        }
+        mr_cursor_t tmp = heap[i];
+        heap[i] = heap[min];
+        heap[min] = tmp;
+        i = min;
+    }
+}
+
+// Interleave the partitions' reduce output by first input record, copying
+// it into result's columns. Each partition's output is in that order
+// already; a heap of partitions picks the next one.
+static int merge_output(const mr_runtime_t *rt, mr_result_t *result) {
+    size_t key_bytes = 0, value_bytes = 0;
+    for (int p = 0; p < rt->num_threads; p++) {
+        result->num_pairs += rt->reduced[p].count;
+        key_bytes += rt->reduced[p].key_bytes;
+        value_bytes += rt->reduced[p].value_bytes;
+    }
+    // One byte more, so that nothing is a malloc(0)
+    result->key_data = malloc(key_bytes + 1);
+    result->key_offsets = malloc((result->num_pairs + 1) * sizeof(size_t));
+    result->value_data = malloc(value_bytes + 1);
+    result->value_offsets = malloc((result->num_pairs + 1) * sizeof(size_t));
+    mr_cursor_t *heap = malloc(rt->num_threads * sizeof(mr_cursor_t));
+    if (result->key_data == NULL || result->key_offsets == NULL ||
+        result->value_data == NULL || result->value_offsets == NULL ||
+        heap == NULL) {
+        free(heap);
+        return -1;
+    }
+
+    int n = 0;
+    for (int p = 0; p < rt->num_threads; p++) {
+        mr_cursor_t c = cursor_start(&rt->reduced[p]);
+        if (c.record) {
+            heap[n++] = c;
+        }
+    }
+    for (int i = n / 2 - 1; i >= 0; i--) {
+        sift_down(heap, n, i);
+    }
+
+    size_t key_end = 0, value_end = 0;
+    for (size_t out = 0; n > 0; out++) {
+        const mr_record_t *record = heap[0].record;
+        result->key_offsets[out] = key_end;
+        result->value_offsets[out] = value_end;
+        memcpy(result->key_data + key_end, record->data, record->key_len);
+        memcpy(result->value_data + value_end, record->data + record->key_len,
+               record->value_len);
+        key_end += record->key_len;
+        value_end += record->value_len;
+
+        cursor_next(&heap[0]);
+        if (heap[0].record == NULL) {
+            heap[0] = heap[--n];
+        }
+        sift_down(heap, n, 0);
+    }
+    result->key_offsets[result->num_pairs] = key_end;
+    result->value_offsets[result->num_pairs] = value_end;
+    free(heap);
+    return 0;
+}
+
+int mr_run(const mr_job_t *job, const void *records, size_t num_records,
+           size_t record_size, mr_result_t *result) {
+    int num_threads = job->num_threads > 0 ? job->num_threads : 1;
+    mr_runtime_t rt = {
+        .job = job,
+        .records = records,
+        .num_records = num_records,
+        .record_size = record_size,
+        .num_threads = num_threads,
+    };
+    size_t num_mapped = (size_t)num_threads * num_threads;
+    rt.mapped = calloc(num_mapped, sizeof(mr_arena_t));
+    rt.reduced = calloc(num_threads, sizeof(mr_arena_t));
+    rt.num_groups = calloc(num_threads, sizeof(size_t));
+    mr_worker_t *workers = malloc(num_threads * sizeof(mr_worker_t));
+    if (rt.mapped == NULL || rt.reduced == NULL || rt.num_groups == NULL ||
+        workers == NULL) {
+        perror("malloc");
+        free(rt.mapped);
+        free(rt.reduced);
+        free(rt.num_groups);
+        free(workers);
+        return -1;
+    }
+    atomic_init(&rt.failed, 0);
+    pthread_mutex_init(&rt.gate_lock, NULL);
+    pthread_cond_init(&rt.gate, NULL);
+    pthread_barrier_init(&rt.barrier, NULL, num_threads);
+
+    rt.start = now_sec();
+    int started = 0;
+    for (; started < num_threads; started++) {
+        workers[started] = (mr_worker_t){&rt, started, 0};
+        if (pthread_create(&workers[started].thread, NULL, worker_thread_func,
+                           &workers[started]) != 0) {
+            perror("pthread_create");
+            atomic_store(&rt.failed, 1);
+            break;
+        }
+    }
+    pthread_mutex_lock(&rt.gate_lock);
+    rt.gate_open = 1;
+    pthread_cond_broadcast(&rt.gate);
+    pthread_mutex_unlock(&rt.gate_lock);
+    for (int t = 0; t < started; t++) {
+        pthread_join(workers[t].thread, NULL);
+    }
+    double reduce_done = now_sec();
+
+    pthread_barrier_destroy(&rt.barrier);
+    pthread_cond_destroy(&rt.gate);
+    pthread_mutex_destroy(&rt.gate_lock);
+    free(workers);
+
+    *result = (mr_result_t){0};
+    for (int p = 0; p < num_threads; p++) {
+        result->num_groups += rt.num_groups[p];
+    }
+    int ret = 0;
+    if (atomic_load(&rt.failed) || merge_output(&rt, result) != 0) {
+        fprintf(stderr, "mr_run: out of memory or threads\n");
+        mr_result_free(result);
+        ret = -1;
+    }
+
+    // The output has been copied out; mapped records are only left if
+    // something failed
+    for (size_t i = 0; i < num_mapped; i++) {
+        arena_free(&rt.mapped[i]);
+    }
+    for (int p = 0; p < num_threads; p++) {
+        arena_free(&rt.reduced[p]);
+    }
+    free(rt.mapped);
+    free(rt.reduced);
+    free(rt.num_groups);
+
+    result->map_secs = rt.map_done - rt.start;
+    result->group_secs = rt.group_done - rt.map_done;
+    result->reduce_secs = reduce_done - rt.group_done;
+    return ret;
+}
+
+void mr_result_free(mr_result_t *result) {
+    free(result->key_data);
+    free(result->key_offsets);
+    free(result->value_data);
+    free(result->value_offsets);
+    *result = (mr_result_t){0};
+}
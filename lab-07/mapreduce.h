@@ -0,0 +1,103 @@
+// Lab 7 - A small multi-threaded MapReduce runtime
+//
+// A job is a map callback, called once per input record, and a reduce
+// callback, called once per distinct key with every value mapped to it.
+// Keys and values are plain byte strings, copied as they are emitted.
+//
+// The records are split into one contiguous slice per worker thread. Every
+// worker maps its slice into growable per-thread arenas, one per partition,
+// picked by the hash of the key. Then every worker takes one partition,
+// groups it with a hash table, copies each group's values next to each other
+// and reduces its groups. Nothing is locked: each arena has one writer, and
+// each partition one reader.
+//
+// The output comes back in the same order a sequential run would give: keys
+// in the order their first record comes in the input, values in input
+// order, and whatever a reduce call emits in the order it emitted it.
+#ifndef MAPREDUCE_H
+#define MAPREDUCE_H
+
+#include <stddef.h>
+
+typedef struct {
+    const void *data;
+    size_t len;
+} mr_bytes_t;
+
+// All the values of one key, in input order
+typedef struct {
+    size_t count;
+    const mr_bytes_t *items;
+} mr_values_t;
+
+typedef struct mr_emitter mr_emitter_t;
+
+// Map record number index (of the input array) by emitting key/value pairs
+typedef void (*mr_map_fn)(const void *record, size_t index, mr_emitter_t *out,
+                          void *arg);
+
+// Reduce all the values of key by emitting output pairs
+typedef void (*mr_reduce_fn)(const mr_bytes_t *key, const mr_values_t *values,
+                             mr_emitter_t *out, void *arg);
+
+// Copy a pair out of a map or reduce callback. Keys and values can be up to
+// 4 GiB each.
+void mr_emit(mr_emitter_t *out, const void *key, size_t key_len,
+             const void *value, size_t value_len);
+
+// Emit key once with all of values concatenated, in order, as its value
+void mr_emit_concat(mr_emitter_t *out, const mr_bytes_t *key,
+                    const mr_values_t *values);
+
+// A buffer of at least size bytes to build a pair in before emitting it.
+// It is reused by the callback's next call, so a callback needn't free it.
+// NULL if out of memory, which fails the job.
+void *mr_scratch(mr_emitter_t *out, size_t size);
+
+typedef struct {
+    mr_map_fn map;
+    mr_reduce_fn reduce;
+    void *arg; // passed to both callbacks
+    int num_threads;
+} mr_job_t;
+
+// The reduce output, in order, stored column by column: all the keys back
+// to back in one allocation, all the values in another. Pair i's key is
+// key_data[key_offsets[i]] .. key_data[key_offsets[i + 1] - 1], and its
+// value likewise. Values that are all arrays of one type stay aligned.
+typedef struct {
+    size_t num_pairs;
+    char *key_data;
+    size_t *key_offsets; // num_pairs + 1 of them
+    char *value_data;
+    size_t *value_offsets;
+
+    size_t num_groups; // distinct keys mapped
+
+    // Wall time of each phase
+    double map_secs;
+    double group_secs;
+    double reduce_secs;
+} mr_result_t;
+
+static inline mr_bytes_t mr_result_key(const mr_result_t *result, size_t i) {
+    return (mr_bytes_t){result->key_data + result->key_offsets[i],
+                        result->key_offsets[i + 1] - result->key_offsets[i]};
+}
+
+static inline mr_bytes_t mr_result_value(const mr_result_t *result,
+                                         size_t i) {
+    return (mr_bytes_t){
+        result->value_data + result->value_offsets[i],
+        result->value_offsets[i + 1] - result->value_offsets[i]};
+}
+
+// Run job over num_records records of record_size bytes each. Each
+// partition (there is one per thread) can group up to 4G distinct keys.
+// Returns -1 if the job could not run; nothing needs freeing then.
+int mr_run(const mr_job_t *job, const void *records, size_t num_records,
+           size_t record_size, mr_result_t *result);
+
+void mr_result_free(mr_result_t *result);
+
+#endif
@@ -0,0 +1,164 @@
+// Lab 7 - Benchmark for the MapReduce runtime
+//
+// Usage: mr_bench [num_records] [max_threads]
+// Runs two jobs at 1, 2, 4, ... max_threads threads and times each phase:
+// the lab's doubling job (group line numbers by doubled value) over random
+// integers, and lab 8's word count over a synthetic corpus with a skewed
+// (roughly Zipf) word distribution. Every run's output is checked against
+// the single-threaded one.
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mapreduce.h"
+
+#define DEFAULT_NUM_RECORDS 2000000
+#define DEFAULT_MAX_THREADS 16
+#define VOCABULARY_SIZE 200000
+#define MAX_WORD_LEN 12
+
+// Doubling job: value -> (value * 2, [line numbers])
+
+static void double_map(const void *record, size_t index, mr_emitter_t *out,
+                       void *arg) {
+    (void)arg;
+    int doubled = *(const int *)record * 2;
+    int line_number = (int)index + 1;
+    mr_emit(out, &doubled, sizeof(int), &line_number, sizeof(int));
+}
+
+static void double_reduce(const mr_bytes_t *key, const mr_values_t *values,
+                          mr_emitter_t *out, void *arg) {
+    (void)arg;
+    mr_emit_concat(out, key, values);
+}
+
+// Word count job: word -> (word, count)
+
+static void word_map(const void *record, size_t index, mr_emitter_t *out,
+                     void *arg) {
+    (void)index;
+    (void)arg;
+    const char *word = *(const char *const *)record;
+    mr_emit(out, word, strlen(word), NULL, 0);
+}
+
+static void word_reduce(const mr_bytes_t *key, const mr_values_t *values,
+                        mr_emitter_t *out, void *arg) {
+    (void)arg;
+    size_t count = values->count;
+    mr_emit(out, key->data, key->len, &count, sizeof(count));
+}
+
+// Random lowercase words of 2..MAX_WORD_LEN letters, stored back to back
+static char *make_vocabulary(const char **vocab, size_t size) {
+    char *storage = malloc(size * (MAX_WORD_LEN + 1));
+    if (storage == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    char *p = storage;
+    for (size_t i = 0; i < size; i++) {
+        size_t len = 2 + rand() % (MAX_WORD_LEN - 1);
+        vocab[i] = p;
+        for (size_t j = 0; j < len; j++) {
+            *p++ = 'a' + rand() % 26;
+        }
+        *p++ = '\0';
+    }
+    return storage;
+}
+
+// FNV-1a over every output pair, to compare runs
+static uint64_t checksum(const mr_result_t *result) {
+    uint64_t h = 14695981039346656037ull;
+    for (size_t i = 0; i < result->num_pairs; i++) {
+        mr_bytes_t parts[] = {mr_result_key(result, i),
+                              mr_result_value(result, i)};
+        for (int k = 0; k < 2; k++) {
+            const unsigned char *p = parts[k].data;
+            for (size_t j = 0; j < parts[k].len; j++) {
+                h = (h ^ p[j]) * 1099511628211ull;
+            }
+            h = (h ^ 0xff) * 1099511628211ull;
+        }
+    }
+    return h;
+}
+
+static void time_job(const char *name, mr_job_t job, const void *records,
+                     size_t num_records, size_t record_size,
+                     int max_threads) {
+    printf("%s: %zu records\n", name, num_records);
+    printf("%-8s%10s%10s%10s%10s%12s%10s\n", "threads", "map s", "group s",
+           "reduce s", "total s", "groups", "speedup");
+
+    double base = 0;
+    uint64_t expected = 0;
+    for (int t = 1; t <= max_threads; t *= 2) {
+        job.num_threads = t;
+        mr_result_t result;
+        if (mr_run(&job, records, num_records, record_size, &result) != 0) {
+            exit(EXIT_FAILURE);
+        }
+        double total = result.map_secs + result.group_secs + result.reduce_secs;
+        uint64_t sum = checksum(&result);
+        if (t == 1) {
+            base = total;
+            expected = sum;
+        }
+        printf("%-8d%10.3f%10.3f%10.3f%10.3f%12zu%9.2fx%s\n", t,
+               result.map_secs, result.group_secs, result.reduce_secs, total,
+               result.num_groups, base / total,
+               sum == expected ? "" : "  (output differs!)");
+        mr_result_free(&result);
+    }
+    printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+    size_t num_records =
+        argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_NUM_RECORDS;
+    int max_threads = argc > 2 ? atoi(argv[2]) : DEFAULT_MAX_THREADS;
+    if (num_records == 0 || max_threads <= 0) {
+        fprintf(stderr, "Usage: %s [num_records] [max_threads]\n", argv[0]);
+        return 1;
+    }
+
+    srand(7);
+    int *values = malloc(num_records * sizeof(int));
+    const char **vocab = malloc(VOCABULARY_SIZE * sizeof(char *));
+    const char **words = malloc(num_records * sizeof(char *));
+    if (values == NULL || vocab == NULL || words == NULL) {
+        perror("malloc");
+        return 1;
+    }
+
+    // About eight lines per doubled value
+    int range = num_records / 8 > 0 ? (int)(num_records / 8) : 1;
+    for (size_t i = 0; i < num_records; i++) {
+        values[i] = rand() % range;
+    }
+    mr_job_t doubling = {.map = double_map, .reduce = double_reduce};
+    time_job("doubling", doubling, values, num_records, sizeof(int),
+             max_threads);
+
+    // Word ranks drawn log-uniformly, so frequent words dominate like in text
+    char *storage = make_vocabulary(vocab, VOCABULARY_SIZE);
+    for (size_t i = 0; i < num_records; i++) {
+        double u = (double)rand() / RAND_MAX;
+        size_t rank = (size_t)pow((double)VOCABULARY_SIZE, u) - 1;
+        words[i] = vocab[rank < VOCABULARY_SIZE ? rank : VOCABULARY_SIZE - 1];
+    }
+    mr_job_t word_count = {.map = word_map, .reduce = word_reduce};
+    time_job("word count", word_count, words, num_records, sizeof(char *),
+             max_threads);
+
+    free(storage);
+    free(words);
+    free(vocab);
+    free(values);
+    return 0;
+}
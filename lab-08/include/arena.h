@@ -0,0 +1,36 @@
+// Lab 8 - Bump-pointer arena for table entries and interned words
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+typedef struct arena_block {
+  struct arena_block *next;
+  size_t used;
+  size_t size;
+  _Alignas(16) char data[];
+} arena_block_t;
+
+// Allocations come out of the first block, one after another. When it runs
+// out a bigger block goes in front of it. Nothing is freed on its own: the
+// whole arena goes at once.
+typedef struct {
+  arena_block_t *blocks;
+} arena_t;
+
+void arena_init(arena_t *arena);
+
+// size bytes aligned to align (a power of two, at most 16). NULL if out of
+// memory.
+void *arena_alloc(arena_t *arena, size_t size, size_t align);
+
+// A NUL-terminated copy of the len bytes at str
+const char *arena_intern(arena_t *arena, const char *str, size_t len);
+
+// Take over every block of from, leaving it empty. What was allocated from
+// either stays valid for as long as into lives.
+void arena_merge(arena_t *into, arena_t *from);
+
+void arena_destroy(arena_t *arena);
+
+#endif
@@ -0,0 +1,8 @@
+// Lab 8 - Cache line size, for keeping data that different threads write
+// on lines of its own
+#ifndef CACHE_LINE_H
+#define CACHE_LINE_H
+
+#define CACHE_LINE 64
+
+#endif
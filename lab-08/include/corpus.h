@@ -0,0 +1,54 @@
+// Lab 8 - Memory-mapped input text and an in-place tokenizer
+#ifndef CORPUS_H
+#define CORPUS_H
+
+#include <stddef.h>
+
+typedef struct {
+  const char *text;
+  size_t len;
+} corpus_t;
+
+// Map path read-only. The spans corpus_tokenize finds point straight into
+// the mapping; the tables copy the words they keep.
+int corpus_map(corpus_t *corpus, const char *path);
+void corpus_unmap(corpus_t *corpus);
+
+// Letters, digits and any byte of a multi-byte UTF-8 character make up
+// words; everything else separates them. The SIMD tokenizers classify bytes
+// the same way.
+static inline int is_word_char(unsigned char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         (c >= '0' && c <= '9') || c >= 0x80;
+}
+
+// Split text into num_ranges ranges of about the same size, ending range i
+// at bounds[i + 1] (bounds[0] is 0). No border falls inside a word.
+void corpus_split(const char *text, size_t len, size_t num_ranges,
+                  size_t *bounds);
+
+// A word found by corpus_tokenize: a view into the text, which is not
+// copied or NUL-terminated
+typedef struct {
+  const char *word;
+  size_t len;
+} word_span_t;
+
+// corpus_tokenize works on 64-byte blocks and needs room for at least this
+// many spans per call
+#define TOKENIZE_MIN_SPANS 128
+
+// Find the next words in text[*pos, end) and move *pos past them. Fills up
+// to max_spans spans and returns how many; 0 once there are no more words.
+// *pos must not start inside a word.
+size_t corpus_tokenize(const char *text, size_t *pos, size_t end,
+                       word_span_t *spans, size_t max_spans);
+
+// Which implementation corpus_tokenize uses: "avx2", "sse2" or "scalar". The
+// best one the CPU supports is picked on first use. corpus_set_tokenizer
+// overrides that (before any thread tokenizes) and returns -1 if the CPU
+// can't run the one asked for.
+const char *corpus_tokenizer(void);
+int corpus_set_tokenizer(const char *name);
+
+#endif
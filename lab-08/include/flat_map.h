@@ -0,0 +1,50 @@
+// Lab 8 - Open-addressing word count table (linear probing, Robin Hood)
+#ifndef FLAT_MAP_H
+#define FLAT_MAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Everything a lookup needs sits in the slot itself: the hash and length are
+// compared before the key is touched, so a probe usually stays within one or
+// two cache lines instead of chasing a bucket chain. An empty slot has a NULL
+// key. Keys are borrowed, like the uthash entries.
+typedef struct {
+  const char *key;
+  uint32_t len;
+  uint32_t hash;
+  size_t count;
+} flat_slot_t;
+
+typedef struct {
+  flat_slot_t *slots;
+  size_t mask; // capacity - 1; the capacity is a power of two
+  size_t size;
+} flat_map_t;
+
+// An empty table; slots are allocated on the first insert
+void flat_map_init(flat_map_t *map);
+
+// Add count to key's count, inserting it if needed. Returns -1 if the table
+// could not grow.
+int flat_map_add(flat_map_t *map, const char *key, size_t len, uint32_t hash,
+                 size_t count);
+
+// The slot holding key, or NULL
+flat_slot_t *flat_map_find(const flat_map_t *map, const char *key, size_t len,
+                           uint32_t hash);
+
+// Take key out of the table. Returns -1 if it wasn't there.
+int flat_map_remove(flat_map_t *map, const char *key, size_t len,
+                    uint32_t hash);
+
+// Make room for size entries without growing again
+int flat_map_reserve(flat_map_t *map, size_t size);
+
+void flat_map_destroy(flat_map_t *map);
+
+static inline size_t flat_map_capacity(const flat_map_t *map) {
+  return map->slots ? map->mask + 1 : 0;
+}
+
+#endif
@@ -0,0 +1,36 @@
+// Lab 8 - Work-stealing task scheduler
+//
+// A fixed set of worker threads, each with its own deque of tasks behind its
+// own mutex. A worker takes its newest task from the back of its own deque;
+// once that is empty it steals the oldest task from the front of another's.
+// Cut the work into many small tasks and a thread that drew the expensive
+// ones no longer holds everyone else up: the others take what it hasn't
+// started.
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stddef.h>
+
+// A task runs on one of the workers, numbered 0 .. num_workers - 1, which a
+// task can use to pick per-worker state that needs no locking
+typedef void (*task_fn_t)(void *arg, size_t worker);
+
+typedef struct scheduler scheduler_t;
+
+// Start num_workers threads. NULL if any of them could not be started.
+scheduler_t *scheduler_create(size_t num_workers);
+
+size_t scheduler_workers(const scheduler_t *sched);
+
+// Queue fn(arg), spreading tasks over the workers' deques in turn. Only for
+// the thread that owns the scheduler, not for the tasks themselves. Returns -1
+// if the task could not be queued.
+int scheduler_submit(scheduler_t *sched, task_fn_t fn, void *arg);
+
+// Wait until every task submitted so far has run
+void scheduler_wait(scheduler_t *sched);
+
+// Wait for the queued tasks, then stop the threads
+void scheduler_destroy(scheduler_t *sched);
+
+#endif
@@ -0,0 +1,39 @@
+// Lab 8 - Word count map split into independently locked shards
+#ifndef SHARDED_MAP_H
+#define SHARDED_MAP_H
+
+#include "cache_line.h"
+#include "word_count.h"
+
+// Number of shards, a power of two
+#define SHARD_BITS 6
+#define SHARD_COUNT (1 << SHARD_BITS)
+
+// Each shard sits on its own cache line(s) so that threads working on
+// different shards never write to the same line
+typedef struct {
+  _Alignas(CACHE_LINE) pthread_mutex_t lock;
+  word_map_t map;
+} count_shard_t;
+
+typedef struct {
+  count_shard_t shards[SHARD_COUNT];
+} sharded_map_t;
+
+int sharded_map_init(sharded_map_t *map);
+
+// Thread-safe: count one more occurrence of word
+void sharded_map_add(sharded_map_t *map, word_t word);
+
+// Move every entry into a single map and destroy the shards
+count_map_t sharded_map_flatten(sharded_map_t *map);
+
+// Which shard/partition a word with this hash value belongs to
+static inline size_t shard_of(unsigned hashv) {
+  return hashv >> (32 - SHARD_BITS);
+}
+
+// Move the entries of maps that share no keys into a single map
+count_map_t count_maps_concat(word_map_t *maps, size_t num_maps);
+
+#endif
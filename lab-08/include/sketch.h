@@ -0,0 +1,75 @@
+// Lab 8 - Approximate word counts in bounded memory
+//
+// A Count-Min Sketch estimates the count of any word, and a Space-Saving
+// summary keeps the heaviest hitters by name. Both only ever overestimate.
+// With m Space-Saving counters over n words, a reported count is at most
+// n / m too high; the Count-Min Sketch (width about 4m) usually tightens
+// that further. Sketches of different threads merge into one with the same
+// guarantees.
+#ifndef SKETCH_H
+#define SKETCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "flat_map.h"
+#include "word_map.h"
+
+// Rows of the Count-Min Sketch: the chance of an estimate being further off
+// than its bound is about e^-CMS_DEPTH
+#define CMS_DEPTH 5
+
+typedef struct {
+  size_t mask; // width - 1; the width is a power of two
+  uint64_t *rows; // CMS_DEPTH rows of width counters
+} count_min_t;
+
+typedef struct {
+  char *word; // the counter's own copy
+  uint32_t len;
+  uint32_t hash;
+  size_t count; // an overestimate...
+  size_t error; // ...by at most this much
+  size_t heap_pos;
+} ss_counter_t;
+
+typedef struct {
+  size_t capacity;
+  size_t size;
+  ss_counter_t *counters;
+  size_t *heap; // counter indices; the smallest count is at heap[0]
+  flat_map_t index; // word -> counter index, kept in the slot's count
+} space_saving_t;
+
+typedef struct {
+  count_min_t cms;
+  space_saving_t ss;
+  size_t total; // words added
+} word_sketch_t;
+
+// A sketch that names up to counters heavy hitters
+int sketch_init(word_sketch_t *sketch, size_t counters);
+void sketch_destroy(word_sketch_t *sketch);
+
+void sketch_add(word_sketch_t *sketch, const char *word, size_t len,
+                size_t count);
+
+// Fold from into into; both must have been made with the same counters
+void sketch_merge(word_sketch_t *into, const word_sketch_t *from);
+
+// Upper bound on the count of word
+size_t sketch_estimate(const word_sketch_t *sketch, const char *word,
+                       size_t len);
+
+// The up to k heaviest hitters, heaviest first, with their estimated
+// counts. The words belong to the sketch.
+size_t sketch_top(const word_sketch_t *sketch, word_count_t *out, size_t k);
+
+// How much any count sketch_top reports can be too high: the largest error
+// of any counter, which is never more than total / counters
+size_t sketch_error_bound(const word_sketch_t *sketch);
+
+// Memory the sketch uses, not counting the heavy hitters' words
+size_t sketch_bytes(const word_sketch_t *sketch);
+
+#endif
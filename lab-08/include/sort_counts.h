@@ -0,0 +1,26 @@
+// Lab 8 - Sorting and top-K over the extracted counts, in threads
+#ifndef SORT_COUNTS_H
+#define SORT_COUNTS_H
+
+#include <stddef.h>
+
+#include "word_count.h"
+
+typedef int (*count_cmp_t)(const void *, const void *);
+
+// qsort comparator: most frequent first, ties alphabetical by word
+int sort_by_count(const void *a, const void *b);
+
+// Sort counts by cmp with thread_count threads: each thread sorts a chunk,
+// then pairs of sorted runs are merged in parallel until one is left
+void sort_counts(word_count_t *counts, size_t num_counts, count_cmp_t cmp,
+                 size_t thread_count);
+
+// Move the k rows that sort first by cmp to the front of counts, in order,
+// and return how many there are (fewer than k if counts is shorter). Each
+// thread keeps the best k of its chunk in a heap; the heaps are merged at
+// the end, so nothing but the candidates is ever sorted.
+size_t top_counts(word_count_t *counts, size_t num_counts, size_t k,
+                  count_cmp_t cmp, size_t thread_count);
+
+#endif
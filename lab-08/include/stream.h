@@ -0,0 +1,53 @@
+// Lab 8 - Counting words from input that keeps coming, with snapshots
+//
+// Readers (one thread per file descriptor) cut what they read into chunks
+// that end between words and queue them. Worker threads count each chunk
+// into their own table. Every interval, a publisher thread takes the
+// workers' new counts, adds them to the running total and publishes a
+// read-only snapshot of it by swapping a pointer, RCU style: readers never
+// block the counting or each other, and an old snapshot is only freed once
+// no reader can still be looking at it.
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "word_count.h"
+
+// Reader slots for stream_read_lock
+#define STREAM_MAX_READERS 8
+
+typedef struct {
+  uint64_t version; // 1 for the first snapshot, then counting up
+  size_t total_words;
+  size_t num_counts;
+  word_count_t *counts; // most frequent first
+} word_snapshot_t;
+
+typedef struct word_stream word_stream_t;
+
+// Start num_workers counting threads and the publisher. Snapshots come out
+// every interval_ms, or less often when nothing new was counted.
+word_stream_t *stream_start(size_t num_workers, unsigned interval_ms);
+
+// Count everything read from fd, on a thread of its own, until end of file;
+// then close fd
+int stream_add_fd(word_stream_t *stream, int fd);
+
+// How many descriptors are still being read
+size_t stream_active_feeds(word_stream_t *stream);
+
+// Wait until every descriptor has been read to the end and counted, publish
+// the final snapshot and stop the threads. Snapshots can still be read.
+void stream_stop(word_stream_t *stream);
+
+void stream_destroy(word_stream_t *stream);
+
+// The latest snapshot (NULL before the first one), valid until reader (one
+// of 0 .. STREAM_MAX_READERS - 1, used by one thread at a time) calls
+// stream_read_unlock
+const word_snapshot_t *stream_read_lock(word_stream_t *stream, size_t reader);
+void stream_read_unlock(word_stream_t *stream, size_t reader);
+
+#endif
@@ -0,0 +1,58 @@
+// Lab 8 - Word counting shared by the lab program and the benchmark
+#ifndef WORD_COUNT_H
+#define WORD_COUNT_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+#include "sketch.h"
+#include "word_map.h"
+
+// A heap-allocated table of counts, freed with delete_table
+typedef word_map_t *count_map_t;
+
+// Takes in an array of words of size num_words and
+// returns a hash table where the key is the word
+// and the value is the number of occurrences
+count_map_t count_words_seq(word_t *words, size_t num_words);
+
+// Same result, counted by thread_count threads. The words are cut into small
+// chunks that the threads take from a work-stealing scheduler, each counting
+// into its own private tables without any locking; the tables are then
+// merged in parallel, one hash partition at a time.
+count_map_t count_words_parallel(word_t *words, size_t num_words,
+                                 size_t thread_count);
+
+// Count the words of text in place, with thread_count threads tokenizing
+// chunks of it the same way
+count_map_t count_text_parallel(const char *text, size_t len,
+                                size_t thread_count);
+
+// Same result as count_words_parallel, with every thread updating a shared
+// sharded map
+count_map_t count_words_sharded(word_t *words, size_t num_words,
+                                size_t thread_count);
+
+// The original parallel version: every thread updates one map behind a
+// single mutex. Kept as the benchmark baseline.
+count_map_t count_words_locked(word_t *words, size_t num_words,
+                               size_t thread_count);
+
+// Approximate counts in bounded memory: each thread fills its own sketch
+// with up to counters heavy hitters, and the sketches are merged into
+// *sketch (to be freed with sketch_destroy). Returns -1 on failure.
+int sketch_words_parallel(word_t *words, size_t num_words, size_t thread_count,
+                          size_t counters, word_sketch_t *sketch);
+int sketch_text_parallel(const char *text, size_t len, size_t thread_count,
+                         size_t counters, word_sketch_t *sketch);
+
+// Copy the counts out into a malloc'd array of *num_counts rows
+word_count_t *count_map_entries(count_map_t word_map, size_t *num_counts);
+
+// qsort comparator: alphabetical (bytewise) by word
+int sort_func(const void *a, const void *b);
+
+void print_counts(const word_count_t *counts, size_t num_counts);
+void delete_table(count_map_t);
+
+#endif
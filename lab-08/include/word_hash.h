@@ -0,0 +1,75 @@
+// Lab 8 - Hash function for words
+//
+// A cut-down wyhash: a key of up to 16 bytes (nearly every word) is read
+// with a few overlapping loads and mixed with two 64x64->128-bit multiplies,
+// where uthash's default (Jenkins) works through it a byte at a time.
+#ifndef WORD_HASH_H
+#define WORD_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define WORD_HASH_P0 0xa0761d6478bd642fULL
+#define WORD_HASH_P1 0xe7037ed1a0b428dbULL
+#define WORD_HASH_SEED 0x8ebc6af09c88c6e3ULL
+
+// Multiply and fold the 128-bit product back into 64 bits
+static inline uint64_t word_hash_mum(uint64_t a, uint64_t b) {
+  __uint128_t r = (__uint128_t)a * b;
+  return (uint64_t)r ^ (uint64_t)(r >> 64);
+}
+
+static inline uint64_t word_hash_r8(const unsigned char *p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline uint64_t word_hash_r4(const unsigned char *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline uint64_t word_hash64(const char *key, size_t len) {
+  const unsigned char *p = (const unsigned char *)key;
+  uint64_t seed = WORD_HASH_SEED;
+  uint64_t a, b;
+
+  if (len <= 16) {
+    if (len >= 4) {
+      // Two pairs of 4-byte loads that overlap for lengths under 8
+      size_t mid = (len >> 3) << 2;
+      a = (word_hash_r4(p) << 32) | word_hash_r4(p + mid);
+      b = (word_hash_r4(p + len - 4) << 32) | word_hash_r4(p + len - 4 - mid);
+    } else if (len > 0) {
+      a = ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) | p[len - 1];
+      b = 0;
+    } else {
+      a = b = 0;
+    }
+  } else {
+    size_t i = len;
+    while (i > 16) {
+      seed = word_hash_mum(word_hash_r8(p) ^ WORD_HASH_P1,
+                           word_hash_r8(p + 8) ^ seed);
+      p += 16;
+      i -= 16;
+    }
+    a = word_hash_r8(p + i - 16);
+    b = word_hash_r8(p + i - 8);
+  }
+
+  return word_hash_mum(WORD_HASH_P1 ^ len,
+                       word_hash_mum(a ^ WORD_HASH_P1, b ^ seed));
+}
+
+// 32 bits are all the tables use. Both halves of the result are well mixed:
+// shard_of takes the top bits and the tables index by the bottom ones.
+static inline unsigned word_hash(const char *key, size_t len) {
+  uint64_t h = word_hash64(key, len);
+  return (unsigned)(h ^ (h >> 32));
+}
+
+#endif
@@ -0,0 +1,75 @@
+// Lab 8 - The table the counters count into, picked at build time
+//
+// Configure with -DWORD_MAP=flat (the default) for the open-addressing table
+// in flat_map.c, or -DWORD_MAP=uthash for the original chained uthash table.
+#ifndef WORD_MAP_H
+#define WORD_MAP_H
+
+#include <stddef.h>
+
+#include "arena.h"
+#include "word_hash.h"
+
+typedef const char *word_t;
+
+// One row of the result, as handed out by word_map_extract. The word is the
+// table's own NUL-terminated copy; len saves a strlen.
+typedef struct {
+  word_t word;
+  size_t len;
+  size_t count;
+} word_count_t;
+
+#ifdef WORD_MAP_FLAT
+#include "flat_map.h"
+
+#define WORD_MAP_NAME "flat"
+
+typedef struct {
+  flat_map_t table;
+  arena_t keys;
+} word_map_t;
+#else
+#include <uthash.h>
+
+#define WORD_MAP_NAME "uthash"
+
+typedef struct {
+  word_t word;
+  size_t count;
+  UT_hash_handle hh;
+} word_count_entry_t;
+
+typedef struct {
+  word_count_entry_t *head;
+  arena_t entries; // the entries and their words
+} word_map_t;
+
+word_count_entry_t *create_entry(arena_t *, word_t, size_t, size_t);
+#endif
+
+// Every table copies the words it holds into its own arena, so the counts
+// outlive the input they were counted from. Only the first occurrence of a
+// word is copied. Merging tables hands the arena over as well, and
+// destroying a table frees it in one go.
+
+void word_map_init(word_map_t *map);
+
+// Add count occurrences of word, whose length is len and hash is hashv. Both
+// tables take the hash from word_hash, so the shard/partition a word belongs
+// to doesn't depend on the table.
+void word_map_add(word_map_t *map, word_t word, size_t len, unsigned hashv,
+                  size_t count);
+
+// Add every count in from to into, leaving from empty
+void word_map_merge(word_map_t *into, word_map_t *from);
+
+// Number of distinct words
+size_t word_map_size(const word_map_t *map);
+
+// Copy the words and counts into out, which has room for word_map_size rows
+void word_map_extract(const word_map_t *map, word_count_t *out);
+
+void word_map_destroy(word_map_t *map);
+
+#endif
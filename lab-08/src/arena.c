@@ -0,0 +1,79 @@
+// Lab 8 - Bump-pointer arena for table entries and interned words
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+// Blocks start small, since count_words_parallel gives every thread one
+// table (and arena) per partition, and double up to ARENA_MAX_BLOCK
+#define ARENA_MIN_BLOCK 4096
+#define ARENA_MAX_BLOCK (1 << 20)
+
+void arena_init(arena_t *arena) { arena->blocks = NULL; }
+
+void *arena_alloc(arena_t *arena, size_t size, size_t align) {
+  arena_block_t *block = arena->blocks;
+  if (block) {
+    size_t start = (block->used + align - 1) & ~(align - 1);
+    if (start + size <= block->size) {
+      block->used = start + size;
+      return block->data + start;
+    }
+  }
+
+  size_t block_size = block ? block->size * 2 : ARENA_MIN_BLOCK;
+  if (block_size > ARENA_MAX_BLOCK) {
+    block_size = ARENA_MAX_BLOCK;
+  }
+  if (block_size < size) {
+    block_size = size;
+  }
+  arena_block_t *fresh = malloc(sizeof(arena_block_t) + block_size);
+  if (!fresh) {
+    return NULL;
+  }
+  fresh->next = block;
+  fresh->size = block_size;
+  fresh->used = size;
+  arena->blocks = fresh;
+  return fresh->data;
+}
+
+const char *arena_intern(arena_t *arena, const char *str, size_t len) {
+  char *copy = arena_alloc(arena, len + 1, 1);
+  if (copy) {
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+  }
+  return copy;
+}
+
+void arena_merge(arena_t *into, arena_t *from) {
+  if (!from->blocks) {
+    return;
+  }
+  if (!into->blocks) {
+    into->blocks = from->blocks;
+    from->blocks = NULL;
+    return;
+  }
+
+  // Slot from's blocks in behind into's current one, which keeps filling
+  arena_block_t *last = from->blocks;
+  while (last->next) {
+    last = last->next;
+  }
+  last->next = into->blocks->next;
+  into->blocks->next = from->blocks;
+  from->blocks = NULL;
+}
+
+void arena_destroy(arena_t *arena) {
+  arena_block_t *block = arena->blocks;
+  while (block) {
+    arena_block_t *next = block->next;
+    free(block);
+    block = next;
+  }
+  arena->blocks = NULL;
+}
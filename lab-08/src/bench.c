@@ -0,0 +1,410 @@
+// Lab 8 - Benchmark for the parallel word counters
+//
+// Usage: bench [num_words] [max_threads]
+// Counts a synthetic corpus with a skewed (roughly Zipf) word distribution
+// using the sequential counter, the single-mutex counter, the sharded
+// counter and the thread-local counter, at 1, 2, 4, ... max_threads threads.
+// The thread-local counter is also timed reading the same words out of one
+// space-separated text, the way a mapped corpus file is counted.
+// Then the distinct words are sorted by word and by count, and the top 100
+// picked, with the same thread counts. Last, the approximate counter's top
+// 100 is checked against the exact one for a few sketch sizes.
+// First come single-thread comparisons of the building blocks: uthash's
+// Jenkins hash against word_hash, each tokenizer the CPU supports, and the
+// two tables are compared head to head on one thread: uthash used
+// the way the lab does (HASH_FIND_STR/HASH_ADD_STR, one malloc per word) and
+// the open-addressing flat_map.
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <uthash.h>
+
+#include "corpus.h"
+#include "flat_map.h"
+#include "sketch.h"
+#include "sort_counts.h"
+#include "word_count.h"
+
+#define DEFAULT_NUM_WORDS 5000000
+#define DEFAULT_MAX_THREADS 64
+#define VOCABULARY_SIZE 200000
+#define MAX_WORD_LEN 12
+#define TOP_WORDS 100
+
+typedef count_map_t (*counter_fn)(word_t *, size_t, size_t);
+
+static double now_sec(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Random lowercase words of 2..MAX_WORD_LEN letters, stored back to back
+static char *make_vocabulary(word_t *vocab, size_t size) {
+  char *storage = malloc(size * (MAX_WORD_LEN + 1));
+  if (!storage) {
+    perror("malloc");
+    exit(EXIT_FAILURE);
+  }
+  char *p = storage;
+  for (size_t i = 0; i < size; i++) {
+    size_t len = 2 + rand() % (MAX_WORD_LEN - 1);
+    vocab[i] = p;
+    for (size_t j = 0; j < len; j++) {
+      *p++ = 'a' + rand() % 26;
+    }
+    *p++ = '\0';
+  }
+  return storage;
+}
+
+// Word ranks drawn log-uniformly, so frequent words dominate like in text
+static void make_corpus(word_t *words, size_t num_words, word_t *vocab,
+                        size_t vocab_size) {
+  for (size_t i = 0; i < num_words; i++) {
+    double u = (double)rand() / RAND_MAX;
+    size_t rank = (size_t)pow((double)vocab_size, u) - 1;
+    words[i] = vocab[rank < vocab_size ? rank : vocab_size - 1];
+  }
+}
+
+// The corpus as text, for text_counter
+static char *corpus_text;
+static size_t corpus_len;
+
+static void make_text(word_t *words, size_t num_words) {
+  corpus_len = 0;
+  for (size_t i = 0; i < num_words; i++) {
+    corpus_len += strlen(words[i]) + 1;
+  }
+  corpus_text = malloc(corpus_len);
+  if (!corpus_text) {
+    perror("malloc");
+    exit(EXIT_FAILURE);
+  }
+  char *p = corpus_text;
+  for (size_t i = 0; i < num_words; i++) {
+    size_t len = strlen(words[i]);
+    memcpy(p, words[i], len);
+    p[len] = i % 16 == 15 ? '\n' : ' ';
+    p += len + 1;
+  }
+}
+
+static size_t total_count(count_map_t map) {
+  size_t num_counts, total = 0;
+  word_count_t *counts = count_map_entries(map, &num_counts);
+  if (!counts) {
+    exit(EXIT_FAILURE);
+  }
+  for (size_t i = 0; i < num_counts; i++) {
+    total += counts[i].count;
+  }
+  free(counts);
+  return total;
+}
+
+typedef struct {
+  word_t word;
+  size_t count;
+  UT_hash_handle hh;
+} uthash_entry_t;
+
+// Count every word, then look every word up again; returns the seconds taken
+// by each pass
+static void time_uthash(word_t *words, size_t num_words, double *count_secs,
+                        double *find_secs) {
+  uthash_entry_t *map = NULL, *w, *tmp;
+  double start = now_sec();
+  for (size_t i = 0; i < num_words; i++) {
+    HASH_FIND_STR(map, words[i], w);
+    if (w) {
+      w->count++;
+    } else {
+      w = malloc(sizeof(uthash_entry_t));
+      w->word = words[i];
+      w->count = 1;
+      HASH_ADD_KEYPTR(hh, map, w->word, strlen(w->word), w);
+    }
+  }
+  *count_secs = now_sec() - start;
+
+  size_t found = 0;
+  start = now_sec();
+  for (size_t i = 0; i < num_words; i++) {
+    HASH_FIND_STR(map, words[i], w);
+    found += w->count;
+  }
+  *find_secs = now_sec() - start;
+  if (found == 0) {
+    exit(EXIT_FAILURE);
+  }
+
+  HASH_ITER(hh, map, w, tmp) {
+    HASH_DEL(map, w);
+    free(w);
+  }
+}
+
+static void time_flat_map(word_t *words, size_t num_words, double *count_secs,
+                          double *find_secs) {
+  flat_map_t map;
+  flat_map_init(&map);
+  double start = now_sec();
+  for (size_t i = 0; i < num_words; i++) {
+    size_t len = strlen(words[i]);
+    if (flat_map_add(&map, words[i], len, word_hash(words[i], len), 1) != 0) {
+      perror("flat_map_add");
+      exit(EXIT_FAILURE);
+    }
+  }
+  *count_secs = now_sec() - start;
+
+  size_t found = 0;
+  start = now_sec();
+  for (size_t i = 0; i < num_words; i++) {
+    size_t len = strlen(words[i]);
+    unsigned hashv = word_hash(words[i], len);
+    found += flat_map_find(&map, words[i], len, hashv)->count;
+  }
+  *find_secs = now_sec() - start;
+  if (found == 0) {
+    exit(EXIT_FAILURE);
+  }
+
+  flat_map_destroy(&map);
+}
+
+static double time_counter(counter_fn fn, word_t *words, size_t num_words,
+                           size_t threads) {
+  double start = now_sec();
+  count_map_t map = fn(words, num_words, threads);
+  double secs = now_sec() - start;
+
+  if (!map) {
+    exit(EXIT_FAILURE);
+  }
+  if (total_count(map) != num_words) {
+    fprintf(stderr, "bench: counts don't add up to %zu words\n", num_words);
+    exit(EXIT_FAILURE);
+  }
+  delete_table(map);
+  return secs;
+}
+
+static count_map_t seq_counter(word_t *words, size_t num_words,
+                               size_t threads) {
+  (void)threads;
+  return count_words_seq(words, num_words);
+}
+
+// Keeps the hash loops from being optimized away
+static volatile unsigned hash_sink;
+
+// Hash every word with uthash's default function and with word_hash
+static void time_hashes(word_t *words, size_t num_words) {
+  unsigned sum = 0;
+  double start = now_sec();
+  for (size_t i = 0; i < num_words; i++) {
+    unsigned hashv;
+    HASH_VALUE(words[i], strlen(words[i]), hashv);
+    sum += hashv;
+  }
+  double jen = now_sec() - start;
+
+  start = now_sec();
+  for (size_t i = 0; i < num_words; i++) {
+    sum += word_hash(words[i], strlen(words[i]));
+  }
+  double wy = now_sec() - start;
+
+  printf("%-10s%12s\n", "hash", "s");
+  printf("%-10s%12.3f\n", "jenkins", jen);
+  printf("%-10s%12.3f\n\n", "word_hash", wy);
+  hash_sink = sum;
+}
+
+// Tokenize the whole text on one thread with each tokenizer
+static void time_tokenizers(size_t num_words) {
+  static const char *names[] = {"avx2", "sse2", "scalar"};
+  const char *best = corpus_tokenizer();
+  word_span_t spans[256];
+
+  printf("%-10s%12s%12s\n", "tokenizer", "s", "GB/s");
+  for (size_t t = 0; t < sizeof(names) / sizeof(names[0]); t++) {
+    if (corpus_set_tokenizer(names[t]) != 0) {
+      printf("%-10s%12s\n", names[t], "n/a");
+      continue;
+    }
+    size_t pos = 0, found = 0, n;
+    double start = now_sec();
+    while ((n = corpus_tokenize(corpus_text, &pos, corpus_len, spans, 256))) {
+      found += n;
+    }
+    double secs = now_sec() - start;
+    if (found != num_words) {
+      fprintf(stderr, "bench: %s tokenizer found %zu of %zu words\n",
+              names[t], found, num_words);
+      exit(EXIT_FAILURE);
+    }
+    printf("%-10s%12.3f%12.2f\n", names[t], secs, corpus_len / secs / 1e9);
+  }
+  printf("\n");
+  corpus_set_tokenizer(best);
+}
+
+// Time one sort_counts (or top_counts, if k isn't 0) on a copy of counts
+static double time_sort(const word_count_t *counts, size_t num_counts,
+                        count_cmp_t cmp, size_t k, size_t threads) {
+  word_count_t *copy = malloc(num_counts * sizeof(word_count_t));
+  if (!copy) {
+    perror("malloc");
+    exit(EXIT_FAILURE);
+  }
+  memcpy(copy, counts, num_counts * sizeof(word_count_t));
+
+  double start = now_sec();
+  if (k) {
+    top_counts(copy, num_counts, k, cmp, threads);
+  } else {
+    sort_counts(copy, num_counts, cmp, threads);
+  }
+  double secs = now_sec() - start;
+
+  free(copy);
+  return secs;
+}
+
+// Sketch the corpus with each number of counters and compare its top
+// TOP_WORDS with the exact counts, which are sorted most frequent first
+static void compare_sketches(word_t *words, size_t num_words,
+                             const word_count_t *exact, size_t num_exact,
+                             size_t threads) {
+  flat_map_t index;
+  flat_map_init(&index);
+  if (flat_map_reserve(&index, num_exact) != 0) {
+    perror("malloc");
+    exit(EXIT_FAILURE);
+  }
+  for (size_t i = 0; i < num_exact; i++) {
+    flat_map_add(&index, exact[i].word, exact[i].len,
+                 word_hash(exact[i].word, exact[i].len), exact[i].count);
+  }
+  size_t k = num_exact < TOP_WORDS ? num_exact : TOP_WORDS;
+  size_t kth_count = k ? exact[k - 1].count : 0;
+
+  printf("\n%zu threads, top %zu\n", threads, k);
+  printf("%-10s%10s%10s%10s%12s%12s\n", "counters", "sketch s", "KiB",
+         "recall", "max over", "bound");
+  static const size_t sizes[] = {100, 1000, 10000};
+  word_count_t top[TOP_WORDS];
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    word_sketch_t sketch;
+    double start = now_sec();
+    if (sketch_words_parallel(words, num_words, threads, sizes[s], &sketch) !=
+        0) {
+      exit(EXIT_FAILURE);
+    }
+    double secs = now_sec() - start;
+
+    // A word counts as found if it ties with one of the exact top k
+    size_t num_top = sketch_top(&sketch, top, k), found = 0, max_over = 0;
+    for (size_t i = 0; i < num_top; i++) {
+      flat_slot_t *slot = flat_map_find(
+          &index, top[i].word, top[i].len, word_hash(top[i].word, top[i].len));
+      size_t count = slot ? slot->count : 0;
+      found += count >= kth_count;
+      if (top[i].count - count > max_over) {
+        max_over = top[i].count - count;
+      }
+    }
+    printf("%-10zu%10.3f%10zu%9.0f%%%12zu%12zu\n", sizes[s], secs,
+           sketch_bytes(&sketch) / 1024, k ? 100.0 * found / k : 100.0,
+           max_over, sketch_error_bound(&sketch));
+    sketch_destroy(&sketch);
+  }
+  flat_map_destroy(&index);
+}
+
+static count_map_t text_counter(word_t *words, size_t num_words,
+                               size_t threads) {
+  (void)words;
+  (void)num_words;
+  return count_text_parallel(corpus_text, corpus_len, threads);
+}
+
+int main(int argc, char *argv[]) {
+  size_t num_words = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_NUM_WORDS;
+  size_t max_threads =
+      argc > 2 ? strtoul(argv[2], NULL, 10) : DEFAULT_MAX_THREADS;
+  if (num_words == 0 || max_threads == 0) {
+    fprintf(stderr, "Usage: %s [num_words] [max_threads]\n", argv[0]);
+    return 1;
+  }
+
+  srand(8);
+  word_t *vocab = malloc(VOCABULARY_SIZE * sizeof(word_t));
+  word_t *words = malloc(num_words * sizeof(word_t));
+  if (!vocab || !words) {
+    perror("malloc");
+    return 1;
+  }
+  char *storage = make_vocabulary(vocab, VOCABULARY_SIZE);
+  make_corpus(words, num_words, vocab, VOCABULARY_SIZE);
+  make_text(words, num_words);
+
+  time_hashes(words, num_words);
+  time_tokenizers(num_words);
+
+  double ut_count, ut_find, flat_count, flat_find;
+  time_uthash(words, num_words, &ut_count, &ut_find);
+  time_flat_map(words, num_words, &flat_count, &flat_find);
+  printf("%-8s%14s%14s\n", "table", "count s", "find s");
+  printf("%-8s%14.3f%14.3f\n", "uthash", ut_count, ut_find);
+  printf("%-8s%14.3f%14.3f\n\n", "flat", flat_count, flat_find);
+
+  double seq = time_counter(seq_counter, words, num_words, 1);
+  printf("%zu words, %s table, sequential: %.3f s (%.1f Mwords/s)\n\n",
+         num_words, WORD_MAP_NAME, seq, num_words / seq / 1e6);
+
+  printf("%-8s%14s%14s%14s%14s%12s\n", "threads", "locked s", "sharded s",
+         "local s", "text s", "speedup");
+  for (size_t t = 1; t <= max_threads; t *= 2) {
+    double locked = time_counter(count_words_locked, words, num_words, t);
+    double sharded = time_counter(count_words_sharded, words, num_words, t);
+    double local = time_counter(count_words_parallel, words, num_words, t);
+    double text = time_counter(text_counter, words, num_words, t);
+    printf("%-8zu%14.3f%14.3f%14.3f%14.3f%11.2fx\n", t, locked, sharded,
+           local, text, seq / local);
+  }
+
+  count_map_t map = count_words_seq(words, num_words);
+  size_t num_counts;
+  word_count_t *counts = count_map_entries(map, &num_counts);
+  if (!counts) {
+    return 1;
+  }
+  printf("\n%zu distinct words\n", num_counts);
+  printf("%-8s%14s%14s%14s\n", "threads", "by word s", "by count s",
+         "top 100 s");
+  for (size_t t = 1; t <= max_threads; t *= 2) {
+    printf("%-8zu%14.3f%14.3f%14.3f\n", t,
+           time_sort(counts, num_counts, sort_func, 0, t),
+           time_sort(counts, num_counts, sort_by_count, 0, t),
+           time_sort(counts, num_counts, sort_by_count, TOP_WORDS, t));
+  }
+
+  sort_counts(counts, num_counts, sort_by_count, max_threads);
+  compare_sketches(words, num_words, counts, num_counts, max_threads);
+  free(counts);
+  delete_table(map);
+
+  free(corpus_text);
+  free(storage);
+  free(words);
+  free(vocab);
+  return 0;
+}
@@ -0,0 +1,270 @@
+// Lab 8 - Memory-mapped input text and an in-place tokenizer
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "corpus.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#endif
+
+#define BLOCK_SIZE 64
+
+int corpus_map(corpus_t *corpus, const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    perror(path);
+    return -1;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    perror("fstat");
+    close(fd);
+    return -1;
+  }
+
+  corpus->text = NULL;
+  corpus->len = st.st_size;
+  if (corpus->len > 0) {
+    void *text = mmap(NULL, corpus->len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (text == MAP_FAILED) {
+      perror("mmap");
+      close(fd);
+      return -1;
+    }
+    // Every thread walks its own range front to back
+    madvise(text, corpus->len, MADV_SEQUENTIAL);
+    corpus->text = text;
+  }
+
+  // The mapping stays valid without the descriptor
+  close(fd);
+  return 0;
+}
+
+void corpus_unmap(corpus_t *corpus) {
+  if (corpus->text) {
+    munmap((void *)corpus->text, corpus->len);
+  }
+  corpus->text = NULL;
+  corpus->len = 0;
+}
+
+void corpus_split(const char *text, size_t len, size_t num_ranges,
+                  size_t *bounds) {
+  bounds[0] = 0;
+  for (size_t i = 1; i < num_ranges; i++) {
+    size_t b = len / num_ranges * i;
+    if (b < bounds[i - 1]) {
+      b = bounds[i - 1];
+    }
+    // Move the border forward to the end of the word it cuts
+    while (b > 0 && b < len && is_word_char(text[b - 1]) &&
+           is_word_char(text[b])) {
+      b++;
+    }
+    bounds[i] = b;
+  }
+  bounds[num_ranges] = len;
+}
+
+// Each classify_* function returns a mask with bit i set when block[i] (of
+// BLOCK_SIZE bytes) is a word character
+static inline uint64_t classify_scalar(const char *block) {
+  uint64_t mask = 0;
+  for (size_t i = 0; i < BLOCK_SIZE; i++) {
+    mask |= (uint64_t)is_word_char(block[i]) << i;
+  }
+  return mask;
+}
+
+#ifdef HAVE_X86_SIMD
+// Bytes compare as signed, so the ones >= 0x80 are the negative ones. OR-ing
+// in 0x20 lowercases letters without moving anything else into 'a'..'z'.
+__attribute__((target("sse2"))) static inline uint64_t
+classify_sse2(const char *block) {
+  uint64_t mask = 0;
+  for (size_t i = 0; i < BLOCK_SIZE; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(block + i));
+    __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    __m128i alpha =
+        _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                      _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+    __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+                                  _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+    __m128i high = _mm_cmplt_epi8(v, _mm_setzero_si128());
+    __m128i word = _mm_or_si128(_mm_or_si128(alpha, digit), high);
+    mask |= (uint64_t)(uint16_t)_mm_movemask_epi8(word) << i;
+  }
+  return mask;
+}
+
+__attribute__((target("avx2"))) static inline uint64_t
+classify_avx2(const char *block) {
+  uint64_t mask = 0;
+  for (size_t i = 0; i < BLOCK_SIZE; i += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(block + i));
+    __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+    __m256i alpha = _mm256_and_si256(
+        _mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+        _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower));
+    __m256i digit =
+        _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)),
+                         _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));
+    __m256i high = _mm256_cmpgt_epi8(_mm256_setzero_si256(), v);
+    __m256i word = _mm256_or_si256(_mm256_or_si256(alpha, digit), high);
+    mask |= (uint64_t)(uint32_t)_mm256_movemask_epi8(word) << i;
+  }
+  return mask;
+}
+#endif
+
+// The tokenizer proper, shared by every implementation. A word starts at a
+// 0->1 edge in the block's mask and ends at a 1->0 edge; in_word carries the
+// last bit over from the previous block. Inlined into each tokenize_* below
+// so that classify is inlined too and compiled for the right instruction set.
+static inline __attribute__((always_inline)) size_t
+tokenize_blocks(uint64_t (*classify)(const char *), const char *text,
+                size_t *pos, size_t end, word_span_t *spans,
+                size_t max_spans) {
+  size_t n = 0;
+  size_t i = *pos;
+  size_t start = i;
+  uint64_t in_word = 0;
+
+  // A block ends at most BLOCK_SIZE / 2 words, and one more may be closed
+  // after the last block
+  while (i < end && n + BLOCK_SIZE / 2 + 1 <= max_spans) {
+    uint64_t mask;
+    if (end - i >= BLOCK_SIZE) {
+      mask = classify(text + i);
+    } else {
+      // Pad the last partial block with separators
+      char tail[BLOCK_SIZE];
+      memset(tail, ' ', BLOCK_SIZE);
+      memcpy(tail, text + i, end - i);
+      mask = classify(tail);
+    }
+
+    uint64_t prev = (mask << 1) | in_word;
+    uint64_t edges = mask ^ prev;
+    while (edges) {
+      size_t k = __builtin_ctzll(edges);
+      if (mask >> k & 1) {
+        start = i + k;
+      } else {
+        spans[n].word = text + start;
+        spans[n].len = i + k - start;
+        n++;
+      }
+      edges &= edges - 1;
+    }
+    in_word = mask >> (BLOCK_SIZE - 1);
+    i += BLOCK_SIZE;
+  }
+
+  if (i >= end) {
+    // Only a word running up to a block border at end is still open
+    if (in_word) {
+      spans[n].word = text + start;
+      spans[n].len = end - start;
+      n++;
+    }
+    *pos = end;
+  } else {
+    // Out of room: come back to the open word, if there is one
+    *pos = in_word ? start : i;
+  }
+  return n;
+}
+
+typedef size_t (*tokenize_fn)(const char *, size_t *, size_t, word_span_t *,
+                              size_t);
+
+static size_t tokenize_scalar(const char *text, size_t *pos, size_t end,
+                              word_span_t *spans, size_t max_spans) {
+  return tokenize_blocks(classify_scalar, text, pos, end, spans, max_spans);
+}
+
+#ifdef HAVE_X86_SIMD
+__attribute__((target("sse2"))) static size_t
+tokenize_sse2(const char *text, size_t *pos, size_t end, word_span_t *spans,
+              size_t max_spans) {
+  return tokenize_blocks(classify_sse2, text, pos, end, spans, max_spans);
+}
+
+__attribute__((target("avx2"))) static size_t
+tokenize_avx2(const char *text, size_t *pos, size_t end, word_span_t *spans,
+              size_t max_spans) {
+  return tokenize_blocks(classify_avx2, text, pos, end, spans, max_spans);
+}
+#endif
+
+static const struct {
+  const char *name;
+  tokenize_fn fn;
+} tokenizers[] = {
+#ifdef HAVE_X86_SIMD
+    {"avx2", tokenize_avx2},
+    {"sse2", tokenize_sse2},
+#endif
+    {"scalar", tokenize_scalar},
+};
+#define NUM_TOKENIZERS (sizeof(tokenizers) / sizeof(tokenizers[0]))
+
+static pthread_once_t tokenizer_once = PTHREAD_ONCE_INIT;
+static size_t tokenizer_index;
+
+static int cpu_supports(const char *name) {
+#ifdef HAVE_X86_SIMD
+  __builtin_cpu_init();
+  if (strcmp(name, "avx2") == 0) {
+    return __builtin_cpu_supports("avx2");
+  }
+  if (strcmp(name, "sse2") == 0) {
+    return __builtin_cpu_supports("sse2");
+  }
+#endif
+  return strcmp(name, "scalar") == 0;
+}
+
+// The first one in tokenizers[] (best first) this CPU can run
+static void pick_tokenizer(void) {
+  tokenizer_index = NUM_TOKENIZERS - 1;
+  for (size_t i = 0; i < NUM_TOKENIZERS; i++) {
+    if (cpu_supports(tokenizers[i].name)) {
+      tokenizer_index = i;
+      break;
+    }
+  }
+}
+
+const char *corpus_tokenizer(void) {
+  pthread_once(&tokenizer_once, pick_tokenizer);
+  return tokenizers[tokenizer_index].name;
+}
+
+int corpus_set_tokenizer(const char *name) {
+  pthread_once(&tokenizer_once, pick_tokenizer);
+  for (size_t i = 0; i < NUM_TOKENIZERS; i++) {
+    if (strcmp(tokenizers[i].name, name) == 0 && cpu_supports(name)) {
+      tokenizer_index = i;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+size_t corpus_tokenize(const char *text, size_t *pos, size_t end,
+                       word_span_t *spans, size_t max_spans) {
+  pthread_once(&tokenizer_once, pick_tokenizer);
+  return tokenizers[tokenizer_index].fn(text, pos, end, spans, max_spans);
+}
@@ -0,0 +1,166 @@
+// Lab 8 - Open-addressing word count table (linear probing, Robin Hood)
+#include <stdlib.h>
+#include <string.h>
+
+#include "flat_map.h"
+
+#define FLAT_MIN_CAPACITY 16
+
+// Grow once more than 7/8 of the slots are in use. Robin Hood keeps probe
+// lengths short even this full.
+static int over_load(size_t size, size_t capacity) {
+  return size * 8 > capacity * 7;
+}
+
+// How far the entry in slot pos is from the slot its hash points at
+static size_t probe_dist(const flat_map_t *map, size_t pos, uint32_t hash) {
+  return (pos - (hash & map->mask)) & map->mask;
+}
+
+// Put entry, which is not in the table, at pos or after it. dist is entry's
+// probe distance at pos. Whenever entry is further from home than the
+// occupant, they swap and the occupant moves on instead ("robbing the rich").
+static void place(flat_map_t *map, size_t pos, size_t dist,
+                  flat_slot_t entry) {
+  for (;;) {
+    flat_slot_t *slot = &map->slots[pos];
+    if (!slot->key) {
+      *slot = entry;
+      return;
+    }
+    size_t slot_dist = probe_dist(map, pos, slot->hash);
+    if (slot_dist < dist) {
+      flat_slot_t displaced = *slot;
+      *slot = entry;
+      entry = displaced;
+      dist = slot_dist;
+    }
+    pos = (pos + 1) & map->mask;
+    dist++;
+  }
+}
+
+static int resize(flat_map_t *map, size_t capacity) {
+  flat_slot_t *old = map->slots;
+  size_t old_capacity = flat_map_capacity(map);
+
+  map->slots = calloc(capacity, sizeof(flat_slot_t));
+  if (!map->slots) {
+    map->slots = old;
+    return -1;
+  }
+  map->mask = capacity - 1;
+
+  for (size_t i = 0; i < old_capacity; i++) {
+    if (old[i].key) {
+      place(map, old[i].hash & map->mask, 0, old[i]);
+    }
+  }
+  free(old);
+  return 0;
+}
+
+void flat_map_init(flat_map_t *map) {
+  map->slots = NULL;
+  map->mask = 0;
+  map->size = 0;
+}
+
+int flat_map_reserve(flat_map_t *map, size_t size) {
+  size_t capacity = flat_map_capacity(map);
+  if (!over_load(size, capacity)) {
+    return 0;
+  }
+  if (capacity == 0) {
+    capacity = FLAT_MIN_CAPACITY;
+  }
+  while (over_load(size, capacity)) {
+    capacity *= 2;
+  }
+  return resize(map, capacity);
+}
+
+int flat_map_add(flat_map_t *map, const char *key, size_t len, uint32_t hash,
+                 size_t count) {
+  size_t pos = hash & map->mask;
+  size_t dist = 0;
+
+  if (map->slots) {
+    // An entry further along would have displaced anything poorer than us,
+    // so the search ends at an empty slot or one closer to home than we are
+    for (;;) {
+      flat_slot_t *slot = &map->slots[pos];
+      if (!slot->key || probe_dist(map, pos, slot->hash) < dist) {
+        break;
+      }
+      if (slot->hash == hash && slot->len == len &&
+          memcmp(slot->key, key, len) == 0) {
+        slot->count += count;
+        return 0;
+      }
+      pos = (pos + 1) & map->mask;
+      dist++;
+    }
+  }
+
+  flat_slot_t entry = {.key = key, .len = len, .hash = hash, .count = count};
+  if (over_load(map->size + 1, flat_map_capacity(map))) {
+    if (flat_map_reserve(map, map->size + 1) != 0) {
+      return -1;
+    }
+    // The slots moved; start over from the new home slot
+    pos = hash & map->mask;
+    dist = 0;
+  }
+  place(map, pos, dist, entry);
+  map->size++;
+  return 0;
+}
+
+flat_slot_t *flat_map_find(const flat_map_t *map, const char *key, size_t len,
+                           uint32_t hash) {
+  if (!map->slots) {
+    return NULL;
+  }
+  size_t pos = hash & map->mask;
+  for (size_t dist = 0;; dist++) {
+    flat_slot_t *slot = &map->slots[pos];
+    if (!slot->key || probe_dist(map, pos, slot->hash) < dist) {
+      return NULL;
+    }
+    if (slot->hash == hash && slot->len == len &&
+        memcmp(slot->key, key, len) == 0) {
+      return slot;
+    }
+    pos = (pos + 1) & map->mask;
+  }
+}
+
+int flat_map_remove(flat_map_t *map, const char *key, size_t len,
+                    uint32_t hash) {
+  flat_slot_t *slot = flat_map_find(map, key, len, hash);
+  if (!slot) {
+    return -1;
+  }
+
+  // Shift the entries after it back one slot, up to the first that is
+  // empty or already home, so no probe sequence has a hole in it
+  size_t pos = slot - map->slots;
+  for (;;) {
+    size_t next = (pos + 1) & map->mask;
+    flat_slot_t *moved = &map->slots[next];
+    if (!moved->key || probe_dist(map, next, moved->hash) == 0) {
+      break;
+    }
+    map->slots[pos] = *moved;
+    pos = next;
+  }
+  map->slots[pos].key = NULL;
+  map->size--;
+  return 0;
+}
+
+void flat_map_destroy(flat_map_t *map) {
+  free(map->slots);
+  flat_map_init(map);
+}
@@ -1,213 +1,290 @@
 // Lab 8 - Starting Code for sorting data in threads using uthash
+#include <arpa/inet.h>
+#include <getopt.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <uthash.h>
-#define THREAD_COUNT 3
-typedef const char *word_t;
-
-typedef struct {
-  word_t word;
-  size_t count;
-  UT_hash_handle hh;
-} word_count_entry_t;
-
-word_count_entry_t *create_entry(word_t, size_t);
-
-typedef word_count_entry_t *count_map_t;
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "corpus.h"
+#include "sort_counts.h"
+#include "stream.h"
+#include "word_count.h"
+#define DEFAULT_TOP_K 10
+#define DEFAULT_INTERVAL_MS 1000
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+          "Usage: %s [-t threads] [-s word|count] [-k K] [file]\n"
+          "       %s [-t threads] -a counters [-k K] [file]\n"
+          "       %s [-t threads] -S | -l port [-i interval ms] [-k K]\n"
+          "  Counts the words of file, or the lab's sample words without one\n"
+          "  -s  sort by word (the default) or by count, most frequent first\n"
+          "  -k  print only the first K words in that order\n"
+          "  -a  estimate the counts of the top K (default %d) words in\n"
+          "      bounded memory, tracking that many heavy hitters\n"
+          "  -S  keep counting stdin, printing the top K words every\n"
+          "      interval (default %d ms) and once more at the end\n"
+          "  -l  the same for whatever is sent to TCP port, until killed\n"
+          "  -t  count with this many threads (default: one per CPU)\n",
+          prog, prog, prog, DEFAULT_TOP_K, DEFAULT_INTERVAL_MS);
+  exit(EXIT_FAILURE);
+}
 
 typedef struct {
-  count_map_t *map;
-  word_t *words;
-  size_t num_words;
-  pthread_mutex_t *lock;
-} count_thread_args_t;
-
-count_thread_args_t *pack_args(count_map_t *map, word_t *words,
-                               size_t num_words, pthread_mutex_t *lock);
-
-static void add_word_counts_in_chunk(count_map_t *map, word_t *words,
-                                     size_t num_words, pthread_mutex_t *lock) {
-  // --------- Task 4 --------- \\
-  // Make this function thread-safe by using the lock
-
-  for (size_t i = 0; i < num_words; i++) {
-    if (lock) {
-      pthread_mutex_lock(lock);
+  word_stream_t *stream;
+  int sfd;
+} acceptor_args_t;
+
+static void *accept_thread_func(void *param) {
+  acceptor_args_t *args = (acceptor_args_t *)param;
+
+  for (;;) {
+    int cfd = accept(args->sfd, NULL, NULL);
+    if (cfd == -1) {
+      perror("accept");
+      continue;
     }
-
-    word_count_entry_t *w = NULL;
-    HASH_FIND_STR(*map, words[i], w);
-
-    if (w) {
-      w->count++;
-    } else {
-      w = create_entry(words[i], 1);
-      HASH_ADD_STR(*map, word, w);
-    }
-
-    if (lock) {
-      pthread_mutex_unlock(lock);
+    if (stream_add_fd(args->stream, cfd) != 0) {
+      close(cfd);
     }
   }
+  return NULL;
 }
 
-static void *counter_thread_func(void *);
-
-static count_map_t count_words_parallel(word_t *words, size_t num_words) {
-  // --------- Task 2 --------- \\
-  // Implement this function
-  // Hints:
-  // - Use counter_thread_func for pthread_create(..) and modify as needed.
-  // - Store the threads and their arguments so you can manage them later
-  // - Initialize and pass the mutex to protect the critical sections (Task 4)
-
-  count_map_t map = NULL;
-  pthread_mutex_t count_mutex;
-
-  pthread_t threads[THREAD_COUNT];
-  count_thread_args_t *threads_args[THREAD_COUNT];
-
-  size_t chunk_size = num_words / THREAD_COUNT;
-
-  // Initialize mutex
-  if (pthread_mutex_init(&count_mutex, NULL) != 0) {
-    perror("pthread_mutex_init");
-    return NULL;
+static int listen_on(int port) {
+  int sfd = socket(AF_INET, SOCK_STREAM, 0);
+  if (sfd == -1) {
+    perror("socket");
+    return -1;
   }
-
-  // initialize threads_args to NULL
-  for (size_t i = 0; i < THREAD_COUNT; i++) {
-    threads_args[i] = NULL;
+  int optval = 1;
+  setsockopt(sfd, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval));
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(struct sockaddr_in));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  if (bind(sfd, (struct sockaddr *)&addr, sizeof(struct sockaddr_in)) == -1 ||
+      listen(sfd, SOMAXCONN) == -1) {
+    perror("bind/listen");
+    close(sfd);
+    return -1;
   }
+  return sfd;
+}
 
-  // Launch threads
-  for (size_t i = 0; i < THREAD_COUNT; i++) {
-    word_t *thread_arg_words = words + i * chunk_size;
-    size_t thread_arg_num_words =
-        chunk_size + (i == THREAD_COUNT - 1 ? num_words % THREAD_COUNT : 0);
-
-    // Prepare the arguments and launch the threads
-    threads_args[i] = pack_args(&map, thread_arg_words, thread_arg_num_words,
-                                &count_mutex);
-
-    if (pthread_create(&threads[i], NULL, counter_thread_func,
-                       (void *)threads_args[i]) != 0) {
-      perror("pthread_create");
-      // cleanup what we have so far
-      for (size_t j = 0; j <= i; j++) {
-        if (threads_args[j]) {
-          free(threads_args[j]);
-        }
-      }
-      pthread_mutex_destroy(&count_mutex);
-      return map;
-    }
+// Print the top_k rows of the latest snapshot, if it is newer than *version
+static void print_snapshot(word_stream_t *stream, size_t top_k,
+                           uint64_t *version) {
+  const word_snapshot_t *snapshot = stream_read_lock(stream, 0);
+  if (snapshot && snapshot->version != *version) {
+    *version = snapshot->version;
+    printf("-- snapshot %lu: %zu words, %zu distinct\n",
+           (unsigned long)snapshot->version, snapshot->total_words,
+           snapshot->num_counts);
+    print_counts(snapshot->counts, snapshot->num_counts < top_k
+                                       ? snapshot->num_counts
+                                       : top_k);
+    fflush(stdout);
   }
+  stream_read_unlock(stream, 0);
+}
 
-  // Wait for threads to finish
-  for (size_t i = 0; i < THREAD_COUNT; i++) {
-    pthread_join(threads[i], NULL);
+// -S and -l: count stdin, or every connection to port, as it comes in
+static int run_stream(int port, unsigned interval_ms, size_t top_k,
+                      size_t threads) {
+  word_stream_t *stream = stream_start(threads, interval_ms);
+  if (!stream) {
+    return 1;
   }
 
-  // Cleanup thread arg memory and destroy mutex
-  for (size_t i = 0; i < THREAD_COUNT; i++) {
-    if (threads_args[i]) {
-      free(threads_args[i]);
+  acceptor_args_t args = {stream, -1};
+  if (port) {
+    args.sfd = listen_on(port);
+    pthread_t acceptor;
+    if (args.sfd == -1 ||
+        pthread_create(&acceptor, NULL, accept_thread_func, &args) != 0) {
+      stream_stop(stream);
+      stream_destroy(stream);
+      return 1;
     }
+  } else if (stream_add_fd(stream, STDIN_FILENO) != 0) {
+    stream_stop(stream);
+    stream_destroy(stream);
+    return 1;
   }
 
-  pthread_mutex_destroy(&count_mutex);
+  // With -l this never ends; the acceptor keeps adding connections
+  uint64_t version = 0;
+  struct timespec interval = {interval_ms / 1000,
+                              (long)(interval_ms % 1000) * 1000000};
+  while (port || stream_active_feeds(stream) > 0) {
+    nanosleep(&interval, NULL);
+    print_snapshot(stream, top_k, &version);
+  }
 
-  return map;
+  stream_stop(stream);
+  print_snapshot(stream, top_k, &version);
+  stream_destroy(stream);
+  return 0;
 }
 
-// Takes in an array of words of size num_words and
-// returns a hash table where the key is the word
-// and the value is the number of occurrences
-static word_count_entry_t *count_words_seq(word_t *words, size_t num_words) {
-  word_count_entry_t *map = NULL;
-
-  // Pass all the words as a single chunk
-  add_word_counts_in_chunk(&map, words, num_words, NULL);
+// -a: print the top_k heavy hitters of a sketch with counters counters, of
+// the corpus if a file was given (an empty one too), else of words
+static int run_approx(const corpus_t *corpus, word_t *words, size_t num_words,
+                      size_t counters, size_t top_k, size_t threads) {
+  word_sketch_t sketch;
+  int ret;
+  if (corpus) {
+    ret = sketch_text_parallel(corpus->text, corpus->len, threads, counters,
+                               &sketch);
+  } else {
+    ret = sketch_words_parallel(words, num_words, threads, counters, &sketch);
+  }
+  if (ret != 0) {
+    return 1;
+  }
 
-  return map;
+  word_count_t *top = malloc(top_k * sizeof(word_count_t));
+  if (!top) {
+    perror("malloc");
+    sketch_destroy(&sketch);
+    return 1;
+  }
+  size_t num_top = sketch_top(&sketch, top, top_k);
+  printf("-- approximate: %zu words, counts at most %zu too high, %zu KiB\n",
+         sketch.total, sketch_error_bound(&sketch),
+         sketch_bytes(&sketch) / 1024);
+  print_counts(top, num_top);
+
+  free(top);
+  sketch_destroy(&sketch);
+  return 0;
 }
 
-int sort_func(word_count_entry_t *a, word_count_entry_t *b);
-
-void print_counts(count_map_t);
-void delete_table(count_map_t);
-
-int main(void) {
+int main(int argc, char *argv[]) {
   word_t words_in[13] = {"the",  "quick", "brown", "fox", "jumps",
                          "over", "the",   "lazy",  "dog", "the",
                          "the",  "fox",   "brown"};
   const size_t words_in_len = 13;
   count_map_t word_map = NULL;
+  corpus_t corpus = {NULL, 0};
+  count_cmp_t cmp = sort_func;
+  size_t top_k = 0;
+  int stream_stdin = 0, port = 0;
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  size_t threads = cpus > 0 ? (size_t)cpus : 1;
+  unsigned interval_ms = DEFAULT_INTERVAL_MS;
+  size_t approx_counters = 0;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "s:k:a:Sl:i:t:")) != -1) {
+    switch (opt) {
+    case 's':
+      if (strcmp(optarg, "word") == 0) {
+        cmp = sort_func;
+      } else if (strcmp(optarg, "count") == 0) {
+        cmp = sort_by_count;
+      } else {
+        usage(argv[0]);
+      }
+      break;
+    case 'k':
+      top_k = strtoul(optarg, NULL, 10);
+      if (top_k == 0) {
+        usage(argv[0]);
+      }
+      break;
+    case 'a':
+      approx_counters = strtoul(optarg, NULL, 10);
+      if (approx_counters == 0) {
+        usage(argv[0]);
+      }
+      break;
+    case 'S':
+      stream_stdin = 1;
+      break;
+    case 'l':
+      port = atoi(optarg);
+      if (port <= 0 || port > 65535) {
+        usage(argv[0]);
+      }
+      break;
+    case 'i':
+      interval_ms = strtoul(optarg, NULL, 10);
+      if (interval_ms == 0) {
+        usage(argv[0]);
+      }
+      break;
+    case 't':
+      threads = strtoul(optarg, NULL, 10);
+      if (threads == 0) {
+        usage(argv[0]);
+      }
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  if (argc - optind > 1) {
+    usage(argv[0]);
+  }
+  if (stream_stdin || port) {
+    if (optind < argc || (stream_stdin && port) || approx_counters) {
+      usage(argv[0]);
+    }
+    return run_stream(port, interval_ms, top_k ? top_k : DEFAULT_TOP_K,
+                      threads);
+  }
 
-  // Task 2: Replace this function call with the parallelized version.
-  word_map = count_words_seq(words_in, words_in_len);
-  // word_map = count_words_parallel(words_in, words_in_len);
+  // An empty file is an empty corpus, not a reason to count the sample
+  int have_file = optind < argc;
+  if (have_file && corpus_map(&corpus, argv[optind]) != 0) {
+    return 1;
+  }
+  if (approx_counters) {
+    int ret = run_approx(have_file ? &corpus : NULL, words_in, words_in_len,
+                         approx_counters, top_k ? top_k : DEFAULT_TOP_K,
+                         threads);
+    corpus_unmap(&corpus);
+    return ret;
+  }
+
+  if (have_file) {
+    word_map = count_text_parallel(corpus.text, corpus.len, threads);
+    // The table has its own copies of the words
+    corpus_unmap(&corpus);
+  } else {
+    // Task 2: Replace this function call with the parallelized version.
+    // word_map = count_words_seq(words_in, words_in_len);
+    word_map = count_words_parallel(words_in, words_in_len, threads);
+  }
 
   // Print table
   if (word_map) {
-    // --------- Task 1 --------- \\
-    // Sort the table by the sort function in uthash using `sort_func`.
-    HASH_SORT(word_map, sort_func);
+    size_t num_counts;
+    word_count_t *counts = count_map_entries(word_map, &num_counts);
 
-    print_counts(word_map);
+    // --------- Task 1 --------- \\
+    // Sort the table by word using `sort_func` (or by count with -s count).
+    if (counts) {
+      if (top_k) {
+        num_counts = top_counts(counts, num_counts, top_k, cmp, threads);
+      } else {
+        sort_counts(counts, num_counts, cmp, threads);
+      }
+      print_counts(counts, num_counts);
+      free(counts);
+    }
   }
 
   // Cleanup
-  if (word_map) {
-    delete_table(word_map);
-  }
+  delete_table(word_map);
 
   return 0;
 }
-
-word_count_entry_t *create_entry(word_t word, size_t count) {
-  word_count_entry_t *ptr = malloc(sizeof(word_count_entry_t));
-  ptr->word = word;
-  ptr->count = count;
-  return ptr;
-}
-
-int sort_func(word_count_entry_t *a, word_count_entry_t *b) {
-  return strcmp(a->word, b->word);
-}
-
-void print_counts(count_map_t word_map) {
-  printf("%-32s%-10s\n", "Word", "Count");
-  word_count_entry_t *current, *tmp;
-  HASH_ITER(hh, word_map, current, tmp) {
-    printf("%-32s%-10zu\n", current->word, current->count);
-  }
-}
-
-void delete_table(count_map_t word_map) {
-  word_count_entry_t *current, *tmp;
-  HASH_ITER(hh, word_map, current, tmp) {
-    HASH_DEL(word_map, current);
-    free(current);
-  }
-}
-
-count_thread_args_t *pack_args(count_map_t *map, word_t *words,
-                               size_t num_words, pthread_mutex_t *lock) {
-  count_thread_args_t *args = malloc(sizeof(count_thread_args_t));
-  args->map = map;
-  args->words = words;
-  args->num_words = num_words;
-  args->lock = lock;
-  return args;
-}
-
-static void *counter_thread_func(void *param) {
-  // Call count_words_in_chunk with the appropriate arguments
-  count_thread_args_t *args = (count_thread_args_t *)param;
-  add_word_counts_in_chunk(args->map, args->words, args->num_words, args->lock);
-
-  return NULL;
-}
\ No newline at end of file
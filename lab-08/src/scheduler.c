@@ -0,0 +1,244 @@
+// Lab 8 - Work-stealing task scheduler
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "cache_line.h"
+#include "scheduler.h"
+
+#define DEQUE_MIN_CAPACITY 64
+
+typedef struct {
+  task_fn_t fn;
+  void *arg;
+} task_t;
+
+// A ring buffer of tasks: the owner pushes and pops at the back, thieves
+// take from the front
+typedef struct {
+  _Alignas(CACHE_LINE) pthread_mutex_t lock;
+  task_t *tasks;
+  size_t mask; // capacity - 1; the capacity is a power of two
+  size_t head, len;
+} task_deque_t;
+
+typedef struct {
+  scheduler_t *sched;
+  size_t id;
+  pthread_t thread;
+} worker_t;
+
+struct scheduler {
+  size_t num_workers;
+  worker_t *workers;
+  task_deque_t *deques;
+  size_t next; // deque the next submitted task goes to
+
+  // Idle workers sleep on work until a task is queued; scheduler_wait sleeps
+  // on idle until none is left unfinished
+  pthread_mutex_t lock;
+  pthread_cond_t work;
+  pthread_cond_t idle;
+  atomic_size_t queued;     // tasks in the deques
+  atomic_size_t unfinished; // tasks submitted but not yet run to the end
+  int stopping;
+};
+
+static int deque_push(task_deque_t *deque, task_t task) {
+  size_t capacity = deque->tasks ? deque->mask + 1 : 0;
+  if (deque->len == capacity) {
+    size_t new_capacity = capacity ? capacity * 2 : DEQUE_MIN_CAPACITY;
+    task_t *tasks = malloc(new_capacity * sizeof(task_t));
+    if (!tasks) {
+      return -1;
+    }
+    for (size_t i = 0; i < deque->len; i++) {
+      tasks[i] = deque->tasks[(deque->head + i) & deque->mask];
+    }
+    free(deque->tasks);
+    deque->tasks = tasks;
+    deque->mask = new_capacity - 1;
+    deque->head = 0;
+  }
+  deque->tasks[(deque->head + deque->len) & deque->mask] = task;
+  deque->len++;
+  return 0;
+}
+
+// Take a task off the back (the owner) or the front (a thief) of deque
+static int deque_take(scheduler_t *sched, task_deque_t *deque, int steal,
+                      task_t *task) {
+  int found = 0;
+  pthread_mutex_lock(&deque->lock);
+  if (deque->len) {
+    if (steal) {
+      *task = deque->tasks[deque->head];
+      deque->head = (deque->head + 1) & deque->mask;
+    } else {
+      *task = deque->tasks[(deque->head + deque->len - 1) & deque->mask];
+    }
+    deque->len--;
+    atomic_fetch_sub(&sched->queued, 1);
+    found = 1;
+  }
+  pthread_mutex_unlock(&deque->lock);
+  return found;
+}
+
+// Own deque first, then everybody else's, starting with the next worker's
+static int find_task(worker_t *worker, task_t *task) {
+  scheduler_t *sched = worker->sched;
+  if (deque_take(sched, &sched->deques[worker->id], 0, task)) {
+    return 1;
+  }
+  for (size_t i = 1; i < sched->num_workers; i++) {
+    size_t victim = (worker->id + i) % sched->num_workers;
+    if (deque_take(sched, &sched->deques[victim], 1, task)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static void *worker_thread_func(void *param) {
+  worker_t *worker = (worker_t *)param;
+  scheduler_t *sched = worker->sched;
+
+  for (;;) {
+    task_t task;
+    if (find_task(worker, &task)) {
+      task.fn(task.arg, worker->id);
+      if (atomic_fetch_sub(&sched->unfinished, 1) == 1) {
+        pthread_mutex_lock(&sched->lock);
+        pthread_cond_broadcast(&sched->idle);
+        pthread_mutex_unlock(&sched->lock);
+      }
+      continue;
+    }
+
+    // A submitter takes the lock to signal after queued goes up, so a task
+    // queued after the check still finds us waiting for its signal
+    pthread_mutex_lock(&sched->lock);
+    while (atomic_load(&sched->queued) == 0 && !sched->stopping) {
+      pthread_cond_wait(&sched->work, &sched->lock);
+    }
+    int done = atomic_load(&sched->queued) == 0 && sched->stopping;
+    pthread_mutex_unlock(&sched->lock);
+    if (done) {
+      return NULL;
+    }
+  }
+}
+
+static void stop_workers(scheduler_t *sched, size_t started) {
+  pthread_mutex_lock(&sched->lock);
+  sched->stopping = 1;
+  pthread_cond_broadcast(&sched->work);
+  pthread_mutex_unlock(&sched->lock);
+  for (size_t i = 0; i < started; i++) {
+    pthread_join(sched->workers[i].thread, NULL);
+  }
+}
+
+static void free_scheduler(scheduler_t *sched) {
+  for (size_t i = 0; i < sched->num_workers; i++) {
+    pthread_mutex_destroy(&sched->deques[i].lock);
+    free(sched->deques[i].tasks);
+  }
+  pthread_cond_destroy(&sched->idle);
+  pthread_cond_destroy(&sched->work);
+  pthread_mutex_destroy(&sched->lock);
+  free(sched->deques);
+  free(sched->workers);
+  free(sched);
+}
+
+scheduler_t *scheduler_create(size_t num_workers) {
+  scheduler_t *sched = calloc(1, sizeof(scheduler_t));
+  if (!sched) {
+    perror("calloc");
+    return NULL;
+  }
+  sched->workers = calloc(num_workers, sizeof(worker_t));
+  sched->deques =
+      aligned_alloc(CACHE_LINE, num_workers * sizeof(task_deque_t));
+  if (!sched->workers || !sched->deques) {
+    perror("malloc");
+    free(sched->workers);
+    free(sched->deques);
+    free(sched);
+    return NULL;
+  }
+  sched->num_workers = num_workers;
+  for (size_t i = 0; i < num_workers; i++) {
+    task_deque_t *deque = &sched->deques[i];
+    pthread_mutex_init(&deque->lock, NULL);
+    deque->tasks = NULL;
+    deque->mask = 0;
+    deque->head = deque->len = 0;
+  }
+  pthread_mutex_init(&sched->lock, NULL);
+  pthread_cond_init(&sched->work, NULL);
+  pthread_cond_init(&sched->idle, NULL);
+  atomic_init(&sched->queued, 0);
+  atomic_init(&sched->unfinished, 0);
+
+  for (size_t i = 0; i < num_workers; i++) {
+    worker_t *worker = &sched->workers[i];
+    worker->sched = sched;
+    worker->id = i;
+    if (pthread_create(&worker->thread, NULL, worker_thread_func, worker) !=
+        0) {
+      perror("pthread_create");
+      stop_workers(sched, i);
+      free_scheduler(sched);
+      return NULL;
+    }
+  }
+  return sched;
+}
+
+size_t scheduler_workers(const scheduler_t *sched) {
+  return sched->num_workers;
+}
+
+int scheduler_submit(scheduler_t *sched, task_fn_t fn, void *arg) {
+  task_deque_t *deque = &sched->deques[sched->next];
+  sched->next = (sched->next + 1) % sched->num_workers;
+
+  atomic_fetch_add(&sched->unfinished, 1);
+  pthread_mutex_lock(&deque->lock);
+  int ret = deque_push(deque, (task_t){.fn = fn, .arg = arg});
+  if (ret == 0) {
+    atomic_fetch_add(&sched->queued, 1);
+  }
+  pthread_mutex_unlock(&deque->lock);
+  if (ret != 0) {
+    perror("malloc");
+    atomic_fetch_sub(&sched->unfinished, 1);
+    return -1;
+  }
+
+  pthread_mutex_lock(&sched->lock);
+  pthread_cond_signal(&sched->work);
+  pthread_mutex_unlock(&sched->lock);
+  return 0;
+}
+
+void scheduler_wait(scheduler_t *sched) {
+  pthread_mutex_lock(&sched->lock);
+  while (atomic_load(&sched->unfinished) != 0) {
+    pthread_cond_wait(&sched->idle, &sched->lock);
+  }
+  pthread_mutex_unlock(&sched->lock);
+}
+
+void scheduler_destroy(scheduler_t *sched) {
+  if (!sched) {
+    return;
+  }
+  scheduler_wait(sched);
+  stop_workers(sched, sched->num_workers);
+  free_scheduler(sched);
+}
@@ -0,0 +1,57 @@
+// Lab 8 - Word count map split into independently locked shards
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sharded_map.h"
+
+int sharded_map_init(sharded_map_t *map) {
+  for (size_t i = 0; i < SHARD_COUNT; i++) {
+    if (pthread_mutex_init(&map->shards[i].lock, NULL) != 0) {
+      while (i-- > 0) {
+        pthread_mutex_destroy(&map->shards[i].lock);
+      }
+      return -1;
+    }
+    word_map_init(&map->shards[i].map);
+  }
+  return 0;
+}
+
+void sharded_map_add(sharded_map_t *map, word_t word) {
+  // Hash once: the top bits pick the shard, and the shard's table reuses the
+  // value (both tables index by the low bits)
+  size_t len = strlen(word);
+  unsigned hashv = word_hash(word, len);
+  count_shard_t *shard = &map->shards[shard_of(hashv)];
+
+  pthread_mutex_lock(&shard->lock);
+  word_map_add(&shard->map, word, len, hashv, 1);
+  pthread_mutex_unlock(&shard->lock);
+}
+
+count_map_t count_maps_concat(word_map_t *maps, size_t num_maps) {
+  count_map_t result = malloc(sizeof(word_map_t));
+  if (!result) {
+    perror("malloc");
+    for (size_t i = 0; i < num_maps; i++) {
+      word_map_destroy(&maps[i]);
+    }
+    return NULL;
+  }
+
+  word_map_init(result);
+  for (size_t i = 0; i < num_maps; i++) {
+    word_map_merge(result, &maps[i]);
+  }
+  return result;
+}
+
+count_map_t sharded_map_flatten(sharded_map_t *map) {
+  word_map_t maps[SHARD_COUNT];
+  for (size_t i = 0; i < SHARD_COUNT; i++) {
+    maps[i] = map->shards[i].map;
+    pthread_mutex_destroy(&map->shards[i].lock);
+  }
+  return count_maps_concat(maps, SHARD_COUNT);
+}
@@ -0,0 +1,321 @@
+// Lab 8 - Approximate word counts in bounded memory
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sketch.h"
+#include "word_hash.h"
+
+// Count-Min columns per Space-Saving counter
+#define CMS_WIDTH_PER_COUNTER 4
+
+// The column of row i: the two halves of the hash give each row its own
+// index (double hashing)
+static size_t cms_column(const count_min_t *cms, uint64_t hash, size_t i) {
+  uint32_t h1 = (uint32_t)hash;
+  uint32_t h2 = (uint32_t)(hash >> 32) | 1;
+  return (h1 + i * h2) & cms->mask;
+}
+
+static size_t cms_estimate(const count_min_t *cms, uint64_t hash) {
+  size_t width = cms->mask + 1;
+  uint64_t min = UINT64_MAX;
+  for (size_t i = 0; i < CMS_DEPTH; i++) {
+    uint64_t c = cms->rows[i * width + cms_column(cms, hash, i)];
+    if (c < min) {
+      min = c;
+    }
+  }
+  return min;
+}
+
+// Restore the heap after counters[heap[pos]] went up
+static void heap_down(space_saving_t *ss, size_t pos) {
+  for (;;) {
+    size_t smallest = pos;
+    size_t l = 2 * pos + 1, r = 2 * pos + 2;
+    if (l < ss->size && ss->counters[ss->heap[l]].count <
+                            ss->counters[ss->heap[smallest]].count) {
+      smallest = l;
+    }
+    if (r < ss->size && ss->counters[ss->heap[r]].count <
+                            ss->counters[ss->heap[smallest]].count) {
+      smallest = r;
+    }
+    if (smallest == pos) {
+      return;
+    }
+    size_t swap = ss->heap[pos];
+    ss->heap[pos] = ss->heap[smallest];
+    ss->heap[smallest] = swap;
+    ss->counters[ss->heap[pos]].heap_pos = pos;
+    ss->counters[ss->heap[smallest]].heap_pos = smallest;
+    pos = smallest;
+  }
+}
+
+static void heap_up(space_saving_t *ss, size_t pos) {
+  while (pos > 0) {
+    size_t parent = (pos - 1) / 2;
+    if (ss->counters[ss->heap[parent]].count <=
+        ss->counters[ss->heap[pos]].count) {
+      return;
+    }
+    size_t swap = ss->heap[pos];
+    ss->heap[pos] = ss->heap[parent];
+    ss->heap[parent] = swap;
+    ss->counters[ss->heap[pos]].heap_pos = pos;
+    ss->counters[ss->heap[parent]].heap_pos = parent;
+    pos = parent;
+  }
+}
+
+static char *copy_word(const char *word, size_t len) {
+  char *copy = malloc(len + 1);
+  if (!copy) {
+    perror("malloc");
+    exit(EXIT_FAILURE);
+  }
+  memcpy(copy, word, len);
+  copy[len] = '\0';
+  return copy;
+}
+
+static void index_add(space_saving_t *ss, size_t i) {
+  ss_counter_t *c = &ss->counters[i];
+  if (flat_map_add(&ss->index, c->word, c->len, c->hash, i) != 0) {
+    perror("flat_map_add");
+    exit(EXIT_FAILURE);
+  }
+}
+
+// Space-Saving: a word with a counter gets count added to it. A new word
+// takes over the smallest counter, inheriting its count as possible error.
+static void ss_add(space_saving_t *ss, const char *word, size_t len,
+                   uint32_t hash, size_t count) {
+  flat_slot_t *slot = flat_map_find(&ss->index, word, len, hash);
+  if (slot) {
+    ss_counter_t *c = &ss->counters[slot->count];
+    c->count += count;
+    heap_down(ss, c->heap_pos);
+    return;
+  }
+
+  size_t i, error = 0;
+  if (ss->size < ss->capacity) {
+    i = ss->size++;
+    ss->heap[i] = i;
+    ss->counters[i].heap_pos = i;
+  } else {
+    i = ss->heap[0];
+    ss_counter_t *victim = &ss->counters[i];
+    flat_map_remove(&ss->index, victim->word, victim->len, victim->hash);
+    free(victim->word);
+    error = victim->count;
+  }
+
+  ss_counter_t *c = &ss->counters[i];
+  c->word = copy_word(word, len);
+  c->len = len;
+  c->hash = hash;
+  c->count = error + count;
+  c->error = error;
+  index_add(ss, i);
+  if (error) {
+    heap_down(ss, c->heap_pos);
+  } else {
+    heap_up(ss, c->heap_pos);
+  }
+}
+
+int sketch_init(word_sketch_t *sketch, size_t counters) {
+  size_t width = 1;
+  while (width < counters * CMS_WIDTH_PER_COUNTER) {
+    width *= 2;
+  }
+  sketch->cms.mask = width - 1;
+  sketch->cms.rows = calloc(CMS_DEPTH * width, sizeof(uint64_t));
+
+  space_saving_t *ss = &sketch->ss;
+  ss->capacity = counters;
+  ss->size = 0;
+  ss->counters = malloc(counters * sizeof(ss_counter_t));
+  ss->heap = malloc(counters * sizeof(size_t));
+  flat_map_init(&ss->index);
+  sketch->total = 0;
+
+  if (!sketch->cms.rows || !ss->counters || !ss->heap ||
+      flat_map_reserve(&ss->index, counters) != 0) {
+    sketch_destroy(sketch);
+    return -1;
+  }
+  return 0;
+}
+
+void sketch_destroy(word_sketch_t *sketch) {
+  space_saving_t *ss = &sketch->ss;
+  for (size_t i = 0; i < ss->size; i++) {
+    free(ss->counters[i].word);
+  }
+  free(ss->counters);
+  free(ss->heap);
+  flat_map_destroy(&ss->index);
+  free(sketch->cms.rows);
+  memset(sketch, 0, sizeof(word_sketch_t));
+}
+
+void sketch_add(word_sketch_t *sketch, const char *word, size_t len,
+                size_t count) {
+  uint64_t hash = word_hash64(word, len);
+  size_t width = sketch->cms.mask + 1;
+  for (size_t i = 0; i < CMS_DEPTH; i++) {
+    sketch->cms.rows[i * width + cms_column(&sketch->cms, hash, i)] += count;
+  }
+  ss_add(&sketch->ss, word, len, (uint32_t)(hash ^ (hash >> 32)), count);
+  sketch->total += count;
+}
+
+typedef struct {
+  const char *word;
+  uint32_t len;
+  uint32_t hash;
+  size_t count;
+  size_t error;
+} ss_candidate_t;
+
+static int by_candidate_count(const void *a, const void *b) {
+  const ss_candidate_t *x = a, *y = b;
+  return (x->count < y->count) - (x->count > y->count);
+}
+
+static size_t ss_min_count(const space_saving_t *ss) {
+  return ss->size == ss->capacity ? ss->counters[ss->heap[0]].count : 0;
+}
+
+// Mergeable Space-Saving: a word missing from one summary may have been
+// counted there up to that summary's smallest count, so that much is added
+// to both its count and its error. The capacity heaviest results are kept.
+static void ss_merge(space_saving_t *into, const space_saving_t *from) {
+  size_t min_into = ss_min_count(into), min_from = ss_min_count(from);
+  ss_candidate_t *cands =
+      malloc((into->size + from->size) * sizeof(ss_candidate_t));
+  if (!cands) {
+    perror("malloc");
+    exit(EXIT_FAILURE);
+  }
+
+  size_t n = 0;
+  for (size_t i = 0; i < into->size; i++) {
+    const ss_counter_t *a = &into->counters[i];
+    flat_slot_t *b = flat_map_find(&from->index, a->word, a->len, a->hash);
+    const ss_counter_t *other = b ? &from->counters[b->count] : NULL;
+    cands[n++] = (ss_candidate_t){
+        a->word, a->len, a->hash,
+        a->count + (other ? other->count : min_from),
+        a->error + (other ? other->error : min_from)};
+  }
+  for (size_t i = 0; i < from->size; i++) {
+    const ss_counter_t *b = &from->counters[i];
+    if (!flat_map_find(&into->index, b->word, b->len, b->hash)) {
+      cands[n++] = (ss_candidate_t){b->word, b->len, b->hash,
+                                    b->count + min_into, b->error + min_into};
+    }
+  }
+  qsort(cands, n, sizeof(ss_candidate_t), by_candidate_count);
+  if (n > into->capacity) {
+    n = into->capacity;
+  }
+
+  // Rebuild into from the survivors. Sorted heaviest first, they make a
+  // min-heap when taken back to front.
+  char **old_words = malloc(into->size * sizeof(char *));
+  size_t old_size = into->size;
+  if (!old_words) {
+    perror("malloc");
+    exit(EXIT_FAILURE);
+  }
+  for (size_t i = 0; i < old_size; i++) {
+    old_words[i] = into->counters[i].word;
+  }
+  flat_map_destroy(&into->index);
+  flat_map_init(&into->index);
+  for (size_t i = 0; i < n; i++) {
+    ss_counter_t *c = &into->counters[i];
+    c->word = copy_word(cands[i].word, cands[i].len);
+    c->len = cands[i].len;
+    c->hash = cands[i].hash;
+    c->count = cands[i].count;
+    c->error = cands[i].error;
+    c->heap_pos = n - 1 - i;
+    into->heap[n - 1 - i] = i;
+    index_add(into, i);
+  }
+  into->size = n;
+  for (size_t i = 0; i < old_size; i++) {
+    free(old_words[i]);
+  }
+  free(old_words);
+  free(cands);
+}
+
+void sketch_merge(word_sketch_t *into, const word_sketch_t *from) {
+  size_t cells = CMS_DEPTH * (into->cms.mask + 1);
+  for (size_t i = 0; i < cells; i++) {
+    into->cms.rows[i] += from->cms.rows[i];
+  }
+  ss_merge(&into->ss, &from->ss);
+  into->total += from->total;
+}
+
+size_t sketch_estimate(const word_sketch_t *sketch, const char *word,
+                       size_t len) {
+  return cms_estimate(&sketch->cms, word_hash64(word, len));
+}
+
+static int by_row_count(const void *a, const void *b) {
+  const word_count_t *x = a, *y = b;
+  return (x->count < y->count) - (x->count > y->count);
+}
+
+size_t sketch_top(const word_sketch_t *sketch, word_count_t *out, size_t k) {
+  const space_saving_t *ss = &sketch->ss;
+  word_count_t *rows = malloc((ss->size + 1) * sizeof(word_count_t));
+  if (!rows) {
+    perror("malloc");
+    return 0;
+  }
+
+  // Both counts are overestimates, so the smaller one is the better bound
+  for (size_t i = 0; i < ss->size; i++) {
+    const ss_counter_t *c = &ss->counters[i];
+    size_t cms = sketch_estimate(sketch, c->word, c->len);
+    rows[i].word = c->word;
+    rows[i].len = c->len;
+    rows[i].count = cms < c->count ? cms : c->count;
+  }
+  qsort(rows, ss->size, sizeof(word_count_t), by_row_count);
+
+  if (k > ss->size) {
+    k = ss->size;
+  }
+  memcpy(out, rows, k * sizeof(word_count_t));
+  free(rows);
+  return k;
+}
+
+size_t sketch_error_bound(const word_sketch_t *sketch) {
+  size_t bound = 0;
+  for (size_t i = 0; i < sketch->ss.size; i++) {
+    if (sketch->ss.counters[i].error > bound) {
+      bound = sketch->ss.counters[i].error;
+    }
+  }
+  return bound;
+}
+
+size_t sketch_bytes(const word_sketch_t *sketch) {
+  const space_saving_t *ss = &sketch->ss;
+  return CMS_DEPTH * (sketch->cms.mask + 1) * sizeof(uint64_t) +
+         ss->capacity * (sizeof(ss_counter_t) + sizeof(size_t)) +
+         flat_map_capacity(&ss->index) * sizeof(flat_slot_t);
+}
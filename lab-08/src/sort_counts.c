@@ -0,0 +1,255 @@
+// Lab 8 - Sorting and top-K over the extracted counts, in threads
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sort_counts.h"
+
+// Below this many rows per thread, more threads don't pay for themselves
+#define SORT_MIN_CHUNK 4096
+
+typedef struct {
+  word_count_t *counts;
+  count_cmp_t cmp;
+  size_t lo, mid, hi; // the rows of this task: [lo, hi), split at mid
+
+  // merge_task_func: copy merged rows into dst
+  word_count_t *dst;
+
+  // top_task_func: the best k of [lo, hi), as a heap, and how many there are
+  size_t k;
+  word_count_t *heap;
+  size_t heap_len;
+} sort_task_t;
+
+// Run fn on every task, one thread each. A task whose thread can't be
+// started runs on the calling thread instead.
+static void run_tasks(void *(*fn)(void *), sort_task_t *tasks,
+                      size_t num_tasks) {
+  pthread_t *threads = malloc(num_tasks * sizeof(pthread_t));
+  int *started = calloc(num_tasks, sizeof(int));
+  if (!threads || !started) {
+    for (size_t i = 0; i < num_tasks; i++) {
+      fn(&tasks[i]);
+    }
+    free(threads);
+    free(started);
+    return;
+  }
+
+  for (size_t i = 0; i < num_tasks; i++) {
+    started[i] = pthread_create(&threads[i], NULL, fn, &tasks[i]) == 0;
+    if (!started[i]) {
+      fn(&tasks[i]);
+    }
+  }
+  for (size_t i = 0; i < num_tasks; i++) {
+    if (started[i]) {
+      pthread_join(threads[i], NULL);
+    }
+  }
+  free(threads);
+  free(started);
+}
+
+// Split [0, num_counts) into num_tasks chunks of about the same size
+static sort_task_t *make_tasks(word_count_t *counts, size_t num_counts,
+                               count_cmp_t cmp, size_t num_tasks) {
+  sort_task_t *tasks = calloc(num_tasks, sizeof(sort_task_t));
+  if (!tasks) {
+    return NULL;
+  }
+  for (size_t i = 0; i < num_tasks; i++) {
+    tasks[i].counts = counts;
+    tasks[i].cmp = cmp;
+    tasks[i].lo = num_counts / num_tasks * i;
+    tasks[i].hi = i == num_tasks - 1 ? num_counts
+                                     : num_counts / num_tasks * (i + 1);
+  }
+  return tasks;
+}
+
+int sort_by_count(const void *a, const void *b) {
+  const word_count_t *x = a, *y = b;
+  if (x->count != y->count) {
+    return x->count > y->count ? -1 : 1;
+  }
+  return sort_func(a, b);
+}
+
+static void *sort_task_func(void *param) {
+  sort_task_t *task = (sort_task_t *)param;
+  qsort(task->counts + task->lo, task->hi - task->lo, sizeof(word_count_t),
+        task->cmp);
+  return NULL;
+}
+
+// Merge the sorted runs [lo, mid) and [mid, hi) of counts into dst
+static void *merge_task_func(void *param) {
+  sort_task_t *task = (sort_task_t *)param;
+  const word_count_t *src = task->counts;
+  size_t i = task->lo, j = task->mid, out = task->lo;
+
+  while (i < task->mid && j < task->hi) {
+    // Take from the left run on ties, which keeps the merge stable
+    if (task->cmp(&src[j], &src[i]) < 0) {
+      task->dst[out++] = src[j++];
+    } else {
+      task->dst[out++] = src[i++];
+    }
+  }
+  memcpy(&task->dst[out], &src[i], (task->mid - i) * sizeof(word_count_t));
+  out += task->mid - i;
+  memcpy(&task->dst[out], &src[j], (task->hi - j) * sizeof(word_count_t));
+  return NULL;
+}
+
+void sort_counts(word_count_t *counts, size_t num_counts, count_cmp_t cmp,
+                 size_t thread_count) {
+  size_t max_threads = num_counts / SORT_MIN_CHUNK;
+  if (thread_count > max_threads) {
+    thread_count = max_threads ? max_threads : 1;
+  }
+  sort_task_t *runs = make_tasks(counts, num_counts, cmp, thread_count);
+  word_count_t *tmp = malloc(num_counts * sizeof(word_count_t));
+  if (!runs || !tmp || thread_count == 1) {
+    qsort(counts, num_counts, sizeof(word_count_t), cmp);
+    free(runs);
+    free(tmp);
+    return;
+  }
+
+  run_tasks(sort_task_func, runs, thread_count);
+
+  // Merge neighbouring runs, halving their number each round. The rows go
+  // back and forth between counts and tmp.
+  sort_task_t *merges = calloc(thread_count, sizeof(sort_task_t));
+  if (!merges) {
+    qsort(counts, num_counts, sizeof(word_count_t), cmp);
+    free(runs);
+    free(tmp);
+    return;
+  }
+  word_count_t *src = counts, *dst = tmp;
+  for (size_t width = 1; width < thread_count; width *= 2) {
+    size_t num_merges = 0;
+    for (size_t r = 0; r < thread_count; r += 2 * width) {
+      sort_task_t *m = &merges[num_merges++];
+      m->counts = src;
+      m->dst = dst;
+      m->cmp = cmp;
+      size_t last = r + 2 * width < thread_count ? r + 2 * width - 1
+                                                 : thread_count - 1;
+      m->lo = runs[r].lo;
+      m->hi = runs[last].hi;
+      // A run without a partner is just copied across
+      m->mid = r + width < thread_count ? runs[r + width].lo : m->hi;
+    }
+    run_tasks(merge_task_func, merges, num_merges);
+
+    word_count_t *swap = src;
+    src = dst;
+    dst = swap;
+  }
+  if (src != counts) {
+    memcpy(counts, src, num_counts * sizeof(word_count_t));
+  }
+
+  free(merges);
+  free(runs);
+  free(tmp);
+}
+
+// heap[0] is the row that sorts last of those kept, the first to be dropped
+static void heap_sift_down(word_count_t *heap, size_t len, size_t i,
+                           count_cmp_t cmp) {
+  for (;;) {
+    size_t worst = i;
+    size_t l = 2 * i + 1, r = 2 * i + 2;
+    if (l < len && cmp(&heap[l], &heap[worst]) > 0) {
+      worst = l;
+    }
+    if (r < len && cmp(&heap[r], &heap[worst]) > 0) {
+      worst = r;
+    }
+    if (worst == i) {
+      return;
+    }
+    word_count_t swap = heap[i];
+    heap[i] = heap[worst];
+    heap[worst] = swap;
+    i = worst;
+  }
+}
+
+static void heap_push(word_count_t *heap, size_t len, word_count_t row,
+                      count_cmp_t cmp) {
+  size_t i = len;
+  heap[i] = row;
+  while (i > 0 && cmp(&heap[i], &heap[(i - 1) / 2]) > 0) {
+    word_count_t swap = heap[i];
+    heap[i] = heap[(i - 1) / 2];
+    heap[(i - 1) / 2] = swap;
+    i = (i - 1) / 2;
+  }
+}
+
+static void *top_task_func(void *param) {
+  sort_task_t *task = (sort_task_t *)param;
+  for (size_t i = task->lo; i < task->hi; i++) {
+    const word_count_t *row = &task->counts[i];
+    if (task->heap_len < task->k) {
+      heap_push(task->heap, task->heap_len++, *row, task->cmp);
+    } else if (task->cmp(row, &task->heap[0]) < 0) {
+      task->heap[0] = *row;
+      heap_sift_down(task->heap, task->heap_len, 0, task->cmp);
+    }
+  }
+  return NULL;
+}
+
+size_t top_counts(word_count_t *counts, size_t num_counts, size_t k,
+                  count_cmp_t cmp, size_t thread_count) {
+  if (k == 0) {
+    return 0;
+  }
+  if (k >= num_counts) {
+    sort_counts(counts, num_counts, cmp, thread_count);
+    return num_counts;
+  }
+  // Each thread should at least fill its heap
+  size_t max_threads = num_counts / (k > SORT_MIN_CHUNK ? k : SORT_MIN_CHUNK);
+  if (thread_count > max_threads) {
+    thread_count = max_threads ? max_threads : 1;
+  }
+
+  // Every thread's heap lives in one array, so that merging them is a
+  // matter of sorting that array
+  sort_task_t *tasks = make_tasks(counts, num_counts, cmp, thread_count);
+  word_count_t *candidates = malloc(thread_count * k * sizeof(word_count_t));
+  if (!tasks || !candidates) {
+    free(tasks);
+    free(candidates);
+    sort_counts(counts, num_counts, cmp, 1);
+    return k;
+  }
+  for (size_t i = 0; i < thread_count; i++) {
+    tasks[i].k = k;
+    tasks[i].heap = candidates + i * k;
+  }
+  run_tasks(top_task_func, tasks, thread_count);
+
+  size_t num_candidates = 0;
+  for (size_t i = 0; i < thread_count; i++) {
+    memmove(candidates + num_candidates, tasks[i].heap,
+            tasks[i].heap_len * sizeof(word_count_t));
+    num_candidates += tasks[i].heap_len;
+  }
+  qsort(candidates, num_candidates, sizeof(word_count_t), cmp);
+  memcpy(counts, candidates, k * sizeof(word_count_t));
+
+  free(tasks);
+  free(candidates);
+  return k;
+}
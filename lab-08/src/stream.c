@@ -0,0 +1,412 @@
+// Lab 8 - Counting words from input that keeps coming, with snapshots
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "corpus.h"
+#include "sharded_map.h"
+#include "sort_counts.h"
+#include "stream.h"
+
+#define STREAM_CHUNK (64 * 1024)
+#define STREAM_QUEUE_LEN 64
+#define TOKENIZE_BATCH 256
+#define GRACE_SLEEP_NS 100000
+
+typedef struct {
+  size_t len;
+  char data[STREAM_CHUNK];
+} stream_chunk_t;
+
+// Counts a worker has made since the publisher last took them
+typedef struct {
+  _Alignas(CACHE_LINE) pthread_mutex_t lock;
+  word_map_t delta;
+  size_t delta_words;
+  pthread_t thread;
+  word_stream_t *stream;
+} stream_worker_t;
+
+typedef struct {
+  _Alignas(CACHE_LINE) atomic_uint_fast64_t epoch; // 0: not reading
+} reader_slot_t;
+
+struct word_stream {
+  // Chunks waiting to be counted; a NULL chunk stops a worker
+  pthread_mutex_t lock;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+  pthread_cond_t feeds_done;
+  stream_chunk_t *queue[STREAM_QUEUE_LEN];
+  size_t head, len;
+  size_t active_feeds;
+
+  size_t num_workers;
+  stream_worker_t *workers;
+
+  // Only the publisher touches the running total
+  pthread_t publisher;
+  pthread_cond_t wake_publisher;
+  int publishing;
+  unsigned interval_ms;
+  word_map_t total;
+  size_t total_words;
+
+  _Atomic(word_snapshot_t *) current;
+  atomic_uint_fast64_t epoch;
+  reader_slot_t readers[STREAM_MAX_READERS];
+};
+
+typedef struct {
+  word_stream_t *stream;
+  int fd;
+} feed_args_t;
+
+static void queue_push(word_stream_t *stream, stream_chunk_t *chunk) {
+  pthread_mutex_lock(&stream->lock);
+  while (stream->len == STREAM_QUEUE_LEN) {
+    pthread_cond_wait(&stream->not_full, &stream->lock);
+  }
+  stream->queue[(stream->head + stream->len) % STREAM_QUEUE_LEN] = chunk;
+  stream->len++;
+  pthread_cond_signal(&stream->not_empty);
+  pthread_mutex_unlock(&stream->lock);
+}
+
+static stream_chunk_t *queue_pop(word_stream_t *stream) {
+  pthread_mutex_lock(&stream->lock);
+  while (stream->len == 0) {
+    pthread_cond_wait(&stream->not_empty, &stream->lock);
+  }
+  stream_chunk_t *chunk = stream->queue[stream->head];
+  stream->head = (stream->head + 1) % STREAM_QUEUE_LEN;
+  stream->len--;
+  pthread_cond_signal(&stream->not_full);
+  pthread_mutex_unlock(&stream->lock);
+  return chunk;
+}
+
+static void *worker_thread_func(void *param) {
+  stream_worker_t *self = (stream_worker_t *)param;
+  word_span_t spans[TOKENIZE_BATCH];
+  stream_chunk_t *chunk;
+
+  while ((chunk = queue_pop(self->stream))) {
+    // A chunk goes into the delta as a whole, so a snapshot never holds
+    // part of one
+    pthread_mutex_lock(&self->lock);
+    size_t pos = 0, n;
+    while ((n = corpus_tokenize(chunk->data, &pos, chunk->len, spans,
+                                TOKENIZE_BATCH))) {
+      for (size_t i = 0; i < n; i++) {
+        word_map_add(&self->delta, spans[i].word, spans[i].len,
+                     word_hash(spans[i].word, spans[i].len), 1);
+      }
+      self->delta_words += n;
+    }
+    pthread_mutex_unlock(&self->lock);
+    free(chunk);
+  }
+  return NULL;
+}
+
+// Read fd to the end, queueing chunks that end between words. The partial
+// word at the end of a read is carried over into the next chunk.
+static void *feed_thread_func(void *param) {
+  feed_args_t args = *(feed_args_t *)param;
+  free(param);
+  word_stream_t *stream = args.stream;
+
+  stream_chunk_t *chunk = malloc(sizeof(stream_chunk_t));
+  if (chunk) {
+    chunk->len = 0;
+  }
+  while (chunk) {
+    ssize_t n = read(args.fd, chunk->data + chunk->len,
+                     STREAM_CHUNK - chunk->len);
+    if (n == -1 && errno == EINTR) {
+      continue;
+    }
+    if (n == -1) {
+      perror("read");
+    }
+    if (n <= 0) {
+      break;
+    }
+    chunk->len += n;
+
+    size_t cut = chunk->len;
+    while (cut > 0 && is_word_char(chunk->data[cut - 1])) {
+      cut--;
+    }
+    if (cut == 0 && chunk->len < STREAM_CHUNK) {
+      continue; // Still inside the first word
+    }
+    if (cut == 0) {
+      cut = chunk->len; // A word as long as a chunk gets split
+    }
+
+    stream_chunk_t *next = malloc(sizeof(stream_chunk_t));
+    if (!next) {
+      perror("malloc");
+      break;
+    }
+    next->len = chunk->len - cut;
+    memcpy(next->data, chunk->data + cut, next->len);
+    chunk->len = cut;
+    queue_push(stream, chunk);
+    chunk = next;
+  }
+  if (chunk && chunk->len > 0) {
+    queue_push(stream, chunk);
+  } else {
+    free(chunk);
+  }
+  close(args.fd);
+
+  pthread_mutex_lock(&stream->lock);
+  if (--stream->active_feeds == 0) {
+    pthread_cond_broadcast(&stream->feeds_done);
+  }
+  pthread_mutex_unlock(&stream->lock);
+  return NULL;
+}
+
+// Wait until no reader can still hold a snapshot published before epoch
+static void wait_for_readers(word_stream_t *stream, uint_fast64_t epoch) {
+  struct timespec pause = {0, GRACE_SLEEP_NS};
+  for (size_t i = 0; i < STREAM_MAX_READERS; i++) {
+    for (;;) {
+      uint_fast64_t seen = atomic_load(&stream->readers[i].epoch);
+      if (seen == 0 || seen >= epoch) {
+        break;
+      }
+      nanosleep(&pause, NULL);
+    }
+  }
+}
+
+static void free_snapshot(word_snapshot_t *snapshot) {
+  if (snapshot) {
+    free(snapshot->counts);
+    free(snapshot);
+  }
+}
+
+// Fold the workers' deltas into the total and publish a snapshot of it.
+// Only ever runs on one thread at a time.
+static void publish(word_stream_t *stream) {
+  size_t new_words = 0;
+  for (size_t i = 0; i < stream->num_workers; i++) {
+    stream_worker_t *worker = &stream->workers[i];
+    word_map_t delta;
+    word_map_init(&delta);
+
+    // Just swap tables under the lock; the merge happens outside it
+    pthread_mutex_lock(&worker->lock);
+    word_map_t taken = worker->delta;
+    worker->delta = delta;
+    new_words += worker->delta_words;
+    worker->delta_words = 0;
+    pthread_mutex_unlock(&worker->lock);
+
+    word_map_merge(&stream->total, &taken);
+    word_map_destroy(&taken);
+  }
+  if (new_words == 0 && atomic_load(&stream->current)) {
+    return;
+  }
+  stream->total_words += new_words;
+
+  // The rows point at words in the total's arena, which lives as long as
+  // the stream
+  word_snapshot_t *snapshot = malloc(sizeof(word_snapshot_t));
+  size_t num_counts;
+  word_count_t *counts = count_map_entries(&stream->total, &num_counts);
+  if (!snapshot || !counts) {
+    perror("publish");
+    free(snapshot);
+    free(counts);
+    return;
+  }
+  sort_counts(counts, num_counts, sort_by_count, stream->num_workers);
+
+  word_snapshot_t *old = atomic_load(&stream->current);
+  snapshot->version = old ? old->version + 1 : 1;
+  snapshot->total_words = stream->total_words;
+  snapshot->num_counts = num_counts;
+  snapshot->counts = counts;
+
+  // Readers that start after the swap see the new snapshot; wait out the
+  // ones that might have picked up the old one
+  atomic_store(&stream->current, snapshot);
+  uint_fast64_t epoch = atomic_fetch_add(&stream->epoch, 1) + 1;
+  wait_for_readers(stream, epoch);
+  free_snapshot(old);
+}
+
+static void *publisher_thread_func(void *param) {
+  word_stream_t *stream = (word_stream_t *)param;
+
+  pthread_mutex_lock(&stream->lock);
+  while (stream->publishing) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += stream->interval_ms / 1000;
+    deadline.tv_nsec += (long)(stream->interval_ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000;
+    }
+    pthread_cond_timedwait(&stream->wake_publisher, &stream->lock, &deadline);
+    if (!stream->publishing) {
+      break;
+    }
+
+    pthread_mutex_unlock(&stream->lock);
+    publish(stream);
+    pthread_mutex_lock(&stream->lock);
+  }
+  pthread_mutex_unlock(&stream->lock);
+  return NULL;
+}
+
+word_stream_t *stream_start(size_t num_workers, unsigned interval_ms) {
+  word_stream_t *stream = calloc(1, sizeof(word_stream_t));
+  stream_worker_t *workers = calloc(num_workers, sizeof(stream_worker_t));
+  if (!stream || !workers) {
+    perror("calloc");
+    free(stream);
+    free(workers);
+    return NULL;
+  }
+
+  pthread_mutex_init(&stream->lock, NULL);
+  pthread_cond_init(&stream->not_empty, NULL);
+  pthread_cond_init(&stream->not_full, NULL);
+  pthread_cond_init(&stream->feeds_done, NULL);
+  pthread_cond_init(&stream->wake_publisher, NULL);
+  stream->interval_ms = interval_ms;
+  stream->publishing = 1;
+  word_map_init(&stream->total);
+  atomic_init(&stream->current, NULL);
+  atomic_init(&stream->epoch, 1);
+  for (size_t i = 0; i < STREAM_MAX_READERS; i++) {
+    atomic_init(&stream->readers[i].epoch, 0);
+  }
+
+  stream->workers = workers;
+  for (; stream->num_workers < num_workers; stream->num_workers++) {
+    stream_worker_t *worker = &workers[stream->num_workers];
+    pthread_mutex_init(&worker->lock, NULL);
+    word_map_init(&worker->delta);
+    worker->stream = stream;
+    if (pthread_create(&worker->thread, NULL, worker_thread_func, worker) !=
+        0) {
+      perror("pthread_create");
+      pthread_mutex_destroy(&worker->lock);
+      break;
+    }
+  }
+  if (stream->num_workers == 0 ||
+      pthread_create(&stream->publisher, NULL, publisher_thread_func,
+                     stream) != 0) {
+    fprintf(stderr, "stream_start: could not start the threads\n");
+    stream->publishing = 0;
+    stream_stop(stream);
+    stream_destroy(stream);
+    return NULL;
+  }
+  return stream;
+}
+
+int stream_add_fd(word_stream_t *stream, int fd) {
+  feed_args_t *args = malloc(sizeof(feed_args_t));
+  if (!args) {
+    perror("malloc");
+    return -1;
+  }
+  args->stream = stream;
+  args->fd = fd;
+
+  pthread_mutex_lock(&stream->lock);
+  stream->active_feeds++;
+  pthread_mutex_unlock(&stream->lock);
+
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, feed_thread_func, args) != 0) {
+    perror("pthread_create");
+    free(args);
+    pthread_mutex_lock(&stream->lock);
+    if (--stream->active_feeds == 0) {
+      pthread_cond_broadcast(&stream->feeds_done);
+    }
+    pthread_mutex_unlock(&stream->lock);
+    return -1;
+  }
+  pthread_detach(thread);
+  return 0;
+}
+
+size_t stream_active_feeds(word_stream_t *stream) {
+  pthread_mutex_lock(&stream->lock);
+  size_t active = stream->active_feeds;
+  pthread_mutex_unlock(&stream->lock);
+  return active;
+}
+
+void stream_stop(word_stream_t *stream) {
+  pthread_mutex_lock(&stream->lock);
+  while (stream->active_feeds > 0) {
+    pthread_cond_wait(&stream->feeds_done, &stream->lock);
+  }
+  int publishing = stream->publishing;
+  stream->publishing = 0;
+  pthread_cond_signal(&stream->wake_publisher);
+  pthread_mutex_unlock(&stream->lock);
+
+  // Workers finish the queue before they get to their NULL
+  for (size_t i = 0; i < stream->num_workers; i++) {
+    queue_push(stream, NULL);
+  }
+  for (size_t i = 0; i < stream->num_workers; i++) {
+    pthread_join(stream->workers[i].thread, NULL);
+  }
+  if (publishing) {
+    pthread_join(stream->publisher, NULL);
+  }
+  publish(stream);
+}
+
+void stream_destroy(word_stream_t *stream) {
+  for (size_t i = 0; i < stream->num_workers; i++) {
+    word_map_destroy(&stream->workers[i].delta);
+    pthread_mutex_destroy(&stream->workers[i].lock);
+  }
+  free(stream->workers);
+  free_snapshot(atomic_load(&stream->current));
+  word_map_destroy(&stream->total);
+  pthread_cond_destroy(&stream->wake_publisher);
+  pthread_cond_destroy(&stream->feeds_done);
+  pthread_cond_destroy(&stream->not_full);
+  pthread_cond_destroy(&stream->not_empty);
+  pthread_mutex_destroy(&stream->lock);
+  free(stream);
+}
+
+const word_snapshot_t *stream_read_lock(word_stream_t *stream,
+                                        size_t reader) {
+  // Announce the epoch before loading the pointer: a publisher that swapped
+  // it before this epoch began won't free what we load
+  atomic_store(&stream->readers[reader].epoch, atomic_load(&stream->epoch));
+  return atomic_load(&stream->current);
+}
+
+void stream_read_unlock(word_stream_t *stream, size_t reader) {
+  atomic_store(&stream->readers[reader].epoch, 0);
+}
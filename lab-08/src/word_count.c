@@ -0,0 +1,452 @@
+// Lab 8 - Counting words sequentially and in threads
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "corpus.h"
+#include "scheduler.h"
+#include "sharded_map.h"
+#include "word_count.h"
+
+// Words tokenized per corpus_tokenize call
+#define TOKENIZE_BATCH 256
+
+// Work handed to the scheduler at a time: a few hundred microseconds of
+// counting, so the tasks still even out when some words are much slower to
+// count than others
+#define COUNT_CHUNK_WORDS 4096
+#define COUNT_CHUNK_BYTES (32 * 1024)
+
+typedef struct {
+  word_map_t *map;
+  sharded_map_t *shards;
+  word_t *words;
+  size_t num_words;
+  pthread_mutex_t *lock;
+
+  // Private to each scheduler worker (or thread of the merge):
+  // count_*_parallel: thread_count x SHARD_COUNT tables
+  size_t id;
+  size_t thread_count;
+  word_map_t *local_parts;
+  // sketch_*_parallel: one sketch each
+  word_sketch_t *sketches;
+
+  // *_text_parallel: the text, cut into chunks
+  const char *text;
+} count_thread_args_t;
+
+// One scheduler task: words[begin, end), text[begin, end) or, when merging,
+// partitions [begin, end)
+typedef struct {
+  const count_thread_args_t *args;
+  size_t begin, end;
+} count_chunk_t;
+static void add_word_counts_in_chunk(word_map_t *map, word_t *words,
+                                     size_t num_words, pthread_mutex_t *lock) {
+  // --------- Task 4 --------- \\
+  // Make this function thread-safe by using the lock
+
+  for (size_t i = 0; i < num_words; i++) {
+    size_t len = strlen(words[i]);
+    unsigned hashv = word_hash(words[i], len);
+
+    if (lock) {
+      pthread_mutex_lock(lock);
+    }
+
+    word_map_add(map, words[i], len, hashv, 1);
+
+    if (lock) {
+      pthread_mutex_unlock(lock);
+    }
+  }
+}
+
+// Count a chunk of words into this worker's own partitioned tables; nothing
+// is shared
+static void local_counter_task(void *param, size_t worker) {
+  const count_chunk_t *chunk = (const count_chunk_t *)param;
+  const count_thread_args_t *args = chunk->args;
+  word_map_t *parts = args->local_parts + worker * SHARD_COUNT;
+
+  for (size_t i = chunk->begin; i < chunk->end; i++) {
+    word_t word = args->words[i];
+    size_t len = strlen(word);
+    unsigned hashv = word_hash(word, len);
+    word_map_add(&parts[shard_of(hashv)], word, len, hashv, 1);
+  }
+}
+
+// Same, for words read in place out of a chunk of the text
+static void text_counter_task(void *param, size_t worker) {
+  const count_chunk_t *chunk = (const count_chunk_t *)param;
+  const count_thread_args_t *args = chunk->args;
+  word_map_t *parts = args->local_parts + worker * SHARD_COUNT;
+
+  size_t pos = chunk->begin;
+  word_span_t spans[TOKENIZE_BATCH];
+  size_t n;
+  while ((n = corpus_tokenize(args->text, &pos, chunk->end, spans,
+                              TOKENIZE_BATCH))) {
+    for (size_t i = 0; i < n; i++) {
+      unsigned hashv = word_hash(spans[i].word, spans[i].len);
+      word_map_add(&parts[shard_of(hashv)], spans[i].word, spans[i].len, hashv,
+                   1);
+    }
+  }
+}
+
+// Approximate versions of the two above: the worker's own sketch stands in
+// for its tables
+static void sketch_counter_task(void *param, size_t worker) {
+  const count_chunk_t *chunk = (const count_chunk_t *)param;
+  const count_thread_args_t *args = chunk->args;
+  word_sketch_t *sketch = &args->sketches[worker];
+
+  for (size_t i = chunk->begin; i < chunk->end; i++) {
+    sketch_add(sketch, args->words[i], strlen(args->words[i]), 1);
+  }
+}
+
+static void sketch_text_task(void *param, size_t worker) {
+  const count_chunk_t *chunk = (const count_chunk_t *)param;
+  const count_thread_args_t *args = chunk->args;
+  word_sketch_t *sketch = &args->sketches[worker];
+
+  size_t pos = chunk->begin;
+  word_span_t spans[TOKENIZE_BATCH];
+  size_t n;
+  while ((n = corpus_tokenize(args->text, &pos, chunk->end, spans,
+                              TOKENIZE_BATCH))) {
+    for (size_t i = 0; i < n; i++) {
+      sketch_add(sketch, spans[i].word, spans[i].len, 1);
+    }
+  }
+}
+
+// Merge partition s of every worker into worker 0's table, for every s in the
+// chunk. Chunks are disjoint, so no locking is needed.
+static void merge_task(void *param, size_t worker) {
+  const count_chunk_t *chunk = (const count_chunk_t *)param;
+  const count_thread_args_t *args = chunk->args;
+  (void)worker;
+
+  for (size_t s = chunk->begin; s < chunk->end; s++) {
+    for (size_t t = 1; t < args->thread_count; t++) {
+      word_map_merge(&args->local_parts[s],
+                     &args->local_parts[t * SHARD_COUNT + s]);
+    }
+  }
+}
+
+static void *counter_thread_func(void *param) {
+  // Call count_words_in_chunk with the appropriate arguments
+  count_thread_args_t *args = (count_thread_args_t *)param;
+  if (args->shards) {
+    for (size_t i = 0; i < args->num_words; i++) {
+      sharded_map_add(args->shards, args->words[i]);
+    }
+  } else {
+    add_word_counts_in_chunk(args->map, args->words, args->num_words,
+                             args->lock);
+  }
+
+  return NULL;
+}
+
+// Split words into thread_count chunks (the remainder goes to the last one)
+// and run fn on each. Returns 0 once every thread is done. Only the
+// baselines divide the work up front like this.
+static int run_counter_threads(void *(*fn)(void *), count_thread_args_t proto,
+                               word_t *words, size_t num_words,
+                               size_t thread_count) {
+  pthread_t *threads = malloc(thread_count * sizeof(pthread_t));
+  count_thread_args_t *threads_args =
+      malloc(thread_count * sizeof(count_thread_args_t));
+  if (!threads || !threads_args) {
+    free(threads);
+    free(threads_args);
+    return -1;
+  }
+
+  size_t chunk_size = num_words / thread_count;
+  size_t launched = 0;
+  for (; launched < thread_count; launched++) {
+    size_t i = launched;
+    threads_args[i] = proto;
+    threads_args[i].id = i;
+    threads_args[i].thread_count = thread_count;
+    threads_args[i].words = words + i * chunk_size;
+    threads_args[i].num_words =
+        chunk_size + (i == thread_count - 1 ? num_words % thread_count : 0);
+
+    if (pthread_create(&threads[i], NULL, fn, &threads_args[i]) != 0) {
+      perror("pthread_create");
+      break;
+    }
+  }
+
+  // Wait for threads to finish
+  for (size_t i = 0; i < launched; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  free(threads);
+  free(threads_args);
+  return launched == thread_count ? 0 : -1;
+}
+
+// Cut [0, len) into chunks of about chunk_len (words, bytes of args->text
+// ending between words, or partitions) and run fn on every chunk with the
+// scheduler. Whichever workers are free take the next chunk, so one that
+// drew slow chunks doesn't hold up the rest. Returns 0 once all have run.
+static int run_chunks(scheduler_t *sched, task_fn_t fn,
+                      const count_thread_args_t *args, size_t len,
+                      size_t chunk_len) {
+  size_t num_chunks = len ? (len + chunk_len - 1) / chunk_len : 0;
+  count_chunk_t *chunks = malloc(num_chunks * sizeof(count_chunk_t));
+  size_t *bounds = malloc((num_chunks + 1) * sizeof(size_t));
+  if (!chunks || !bounds) {
+    perror("malloc");
+    free(chunks);
+    free(bounds);
+    return -1;
+  }
+  if (args->text) {
+    corpus_split(args->text, len, num_chunks, bounds);
+  } else {
+    for (size_t i = 0; i <= num_chunks; i++) {
+      bounds[i] = i * chunk_len < len ? i * chunk_len : len;
+    }
+  }
+
+  int ret = 0;
+  for (size_t i = 0; i < num_chunks && ret == 0; i++) {
+    chunks[i] = (count_chunk_t){args, bounds[i], bounds[i + 1]};
+    ret = scheduler_submit(sched, fn, &chunks[i]);
+  }
+  // Even after a failure, the chunks already queued still point into chunks
+  scheduler_wait(sched);
+
+  free(chunks);
+  free(bounds);
+  return ret;
+}
+
+// Chunk size for args: smaller chunks balance better, bigger ones cost less
+// to hand out
+static size_t count_chunk_len(const count_thread_args_t *args) {
+  return args->text ? COUNT_CHUNK_BYTES : COUNT_CHUNK_WORDS;
+}
+
+// Run count_fn on every chunk of len words or bytes into the workers' private
+// partitioned tables, then merge them: the shared half of
+// count_words_parallel and count_text_parallel
+static count_map_t count_local_then_merge(task_fn_t count_fn,
+                                          count_thread_args_t args, size_t len,
+                                          size_t thread_count) {
+  size_t num_parts = thread_count * SHARD_COUNT;
+  word_map_t *local_parts = malloc(num_parts * sizeof(word_map_t));
+  scheduler_t *sched = local_parts ? scheduler_create(thread_count) : NULL;
+  if (!sched) {
+    perror("count_local_then_merge");
+    free(local_parts);
+    return NULL;
+  }
+  for (size_t i = 0; i < num_parts; i++) {
+    word_map_init(&local_parts[i]);
+  }
+
+  // Phase 1: count with no synchronization beyond taking chunks
+  args.local_parts = local_parts;
+  args.thread_count = thread_count;
+  count_map_t map = NULL;
+  if (run_chunks(sched, count_fn, &args, len, count_chunk_len(&args)) == 0) {
+    // Phase 2: merge, a partition at a time. Worker 0's tables end up holding
+    // everything.
+    args.text = NULL;
+    if (run_chunks(sched, merge_task, &args, SHARD_COUNT, 1) == 0) {
+      map = count_maps_concat(local_parts, SHARD_COUNT);
+    }
+  }
+  scheduler_destroy(sched);
+
+  // Some chunks were never counted if that failed; give back what was
+  for (size_t i = 0; i < num_parts; i++) {
+    word_map_destroy(&local_parts[i]);
+  }
+  free(local_parts);
+  return map;
+}
+
+count_map_t count_words_parallel(word_t *words, size_t num_words,
+                                 size_t thread_count) {
+  count_thread_args_t args = {.words = words};
+  return count_local_then_merge(local_counter_task, args, num_words,
+                                thread_count);
+}
+
+count_map_t count_text_parallel(const char *text, size_t len,
+                                size_t thread_count) {
+  count_thread_args_t args = {.text = text};
+  return count_local_then_merge(text_counter_task, args, len, thread_count);
+}
+
+// Run count_fn on every chunk into the workers' own sketches, then fold them
+// all into the first one, which becomes *sketch
+static int sketch_then_merge(task_fn_t count_fn, count_thread_args_t args,
+                             size_t len, size_t thread_count, size_t counters,
+                             word_sketch_t *sketch) {
+  word_sketch_t *sketches = calloc(thread_count, sizeof(word_sketch_t));
+  scheduler_t *sched = sketches ? scheduler_create(thread_count) : NULL;
+  if (!sched) {
+    perror("sketch_then_merge");
+    free(sketches);
+    return -1;
+  }
+  size_t ready = 0;
+  while (ready < thread_count && sketch_init(&sketches[ready], counters) == 0) {
+    ready++;
+  }
+
+  args.sketches = sketches;
+  int ret = -1;
+  if (ready == thread_count &&
+      run_chunks(sched, count_fn, &args, len, count_chunk_len(&args)) == 0) {
+    for (size_t i = 1; i < thread_count; i++) {
+      sketch_merge(&sketches[0], &sketches[i]);
+    }
+    *sketch = sketches[0];
+    ret = 0;
+  } else {
+    fprintf(stderr, "sketch: could not count in %zu threads\n", thread_count);
+    sketch_destroy(&sketches[0]);
+  }
+  scheduler_destroy(sched);
+
+  for (size_t i = 1; i < ready; i++) {
+    sketch_destroy(&sketches[i]);
+  }
+  free(sketches);
+  return ret;
+}
+
+int sketch_words_parallel(word_t *words, size_t num_words, size_t thread_count,
+                          size_t counters, word_sketch_t *sketch) {
+  count_thread_args_t args = {.words = words};
+  return sketch_then_merge(sketch_counter_task, args, num_words, thread_count,
+                           counters, sketch);
+}
+
+int sketch_text_parallel(const char *text, size_t len, size_t thread_count,
+                         size_t counters, word_sketch_t *sketch) {
+  count_thread_args_t args = {.text = text};
+  return sketch_then_merge(sketch_text_task, args, len, thread_count, counters,
+                           sketch);
+}
+
+count_map_t count_words_sharded(word_t *words, size_t num_words,
+                                size_t thread_count) {
+  sharded_map_t *shards = malloc(sizeof(sharded_map_t));
+  if (!shards || sharded_map_init(shards) != 0) {
+    perror("sharded_map_init");
+    free(shards);
+    return NULL;
+  }
+
+  count_thread_args_t proto = {.shards = shards};
+  int ret = run_counter_threads(counter_thread_func, proto, words, num_words,
+                                thread_count);
+
+  count_map_t map = sharded_map_flatten(shards);
+  free(shards);
+  if (ret != 0) {
+    fprintf(stderr, "sharded: could not count in %zu threads\n",
+            thread_count);
+    delete_table(map);
+    return NULL;
+  }
+  return map;
+}
+
+count_map_t count_words_locked(word_t *words, size_t num_words,
+                               size_t thread_count) {
+  count_map_t map = malloc(sizeof(word_map_t));
+  pthread_mutex_t count_mutex;
+  if (!map) {
+    perror("malloc");
+    return NULL;
+  }
+  word_map_init(map);
+
+  // Initialize mutex
+  if (pthread_mutex_init(&count_mutex, NULL) != 0) {
+    perror("pthread_mutex_init");
+    free(map);
+    return NULL;
+  }
+
+  count_thread_args_t proto = {.map = map, .lock = &count_mutex};
+  int ret = run_counter_threads(counter_thread_func, proto, words, num_words,
+                                thread_count);
+
+  pthread_mutex_destroy(&count_mutex);
+
+  if (ret != 0) {
+    fprintf(stderr, "locked: could not count in %zu threads\n",
+            thread_count);
+    delete_table(map);
+    return NULL;
+  }
+  return map;
+}
+
+count_map_t count_words_seq(word_t *words, size_t num_words) {
+  count_map_t map = malloc(sizeof(word_map_t));
+  if (!map) {
+    perror("malloc");
+    return NULL;
+  }
+  word_map_init(map);
+
+  // Pass all the words as a single chunk
+  add_word_counts_in_chunk(map, words, num_words, NULL);
+
+  return map;
+}
+
+word_count_t *count_map_entries(count_map_t word_map, size_t *num_counts) {
+  *num_counts = word_map_size(word_map);
+  word_count_t *counts = malloc((*num_counts + 1) * sizeof(word_count_t));
+  if (!counts) {
+    perror("malloc");
+    return NULL;
+  }
+  word_map_extract(word_map, counts);
+  return counts;
+}
+
+int sort_func(const void *a, const void *b) {
+  const word_count_t *x = a, *y = b;
+  int cmp = memcmp(x->word, y->word, x->len < y->len ? x->len : y->len);
+  if (cmp != 0) {
+    return cmp;
+  }
+  return (x->len > y->len) - (x->len < y->len);
+}
+
+void print_counts(const word_count_t *counts, size_t num_counts) {
+  printf("%-32s%-10s\n", "Word", "Count");
+  for (size_t i = 0; i < num_counts; i++) {
+    printf("%-32.*s%-10zu\n", (int)counts[i].len, counts[i].word,
+           counts[i].count);
+  }
+}
+
+void delete_table(count_map_t word_map) {
+  if (word_map) {
+    word_map_destroy(word_map);
+    free(word_map);
+  }
+}
@@ -0,0 +1,72 @@
+// Lab 8 - word_map_t backed by the open-addressing table
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "word_map.h"
+
+void word_map_init(word_map_t *map) {
+  flat_map_init(&map->table);
+  arena_init(&map->keys);
+}
+
+void word_map_add(word_map_t *map, word_t word, size_t len, unsigned hashv,
+                  size_t count) {
+  flat_slot_t *slot = flat_map_find(&map->table, word, len, hashv);
+  if (slot) {
+    slot->count += count;
+    return;
+  }
+
+  const char *key = arena_intern(&map->keys, word, len);
+  if (!key || flat_map_add(&map->table, key, len, hashv, count) != 0) {
+    perror("word_map_add");
+    exit(EXIT_FAILURE);
+  }
+}
+
+void word_map_merge(word_map_t *into, word_map_t *from) {
+  if (into->table.size == 0) {
+    word_map_destroy(into);
+    *into = *from;
+    word_map_init(from);
+    return;
+  }
+
+  flat_map_t *table = &into->table;
+  if (flat_map_reserve(table, table->size + from->table.size) != 0) {
+    perror("flat_map_reserve");
+    exit(EXIT_FAILURE);
+  }
+  // from's keys are already copies; keep pointing at them and take over
+  // the arena they live in
+  for (size_t i = 0; i < flat_map_capacity(&from->table); i++) {
+    flat_slot_t *slot = &from->table.slots[i];
+    if (slot->key &&
+        flat_map_add(table, slot->key, slot->len, slot->hash, slot->count) !=
+            0) {
+      perror("flat_map_add");
+      exit(EXIT_FAILURE);
+    }
+  }
+  flat_map_destroy(&from->table);
+  arena_merge(&into->keys, &from->keys);
+}
+
+size_t word_map_size(const word_map_t *map) { return map->table.size; }
+
+void word_map_extract(const word_map_t *map, word_count_t *out) {
+  const flat_map_t *table = &map->table;
+  for (size_t i = 0; i < flat_map_capacity(table); i++) {
+    if (table->slots[i].key) {
+      out->word = table->slots[i].key;
+      out->len = table->slots[i].len;
+      out->count = table->slots[i].count;
+      out++;
+    }
+  }
+}
+
+void word_map_destroy(word_map_t *map) {
+  flat_map_destroy(&map->table);
+  arena_destroy(&map->keys);
+}
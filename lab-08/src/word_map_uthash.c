@@ -0,0 +1,82 @@
+// Lab 8 - word_map_t backed by uthash, with the entries in an arena
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "word_map.h"
+
+word_count_entry_t *create_entry(arena_t *arena, word_t word, size_t len,
+                                 size_t count) {
+  word_count_entry_t *ptr = arena_alloc(arena, sizeof(word_count_entry_t),
+                                        _Alignof(word_count_entry_t));
+  if (ptr) {
+    ptr->word = arena_intern(arena, word, len);
+    ptr->count = count;
+  }
+  if (!ptr || !ptr->word) {
+    perror("create_entry");
+    exit(EXIT_FAILURE);
+  }
+  return ptr;
+}
+
+void word_map_init(word_map_t *map) {
+  map->head = NULL;
+  arena_init(&map->entries);
+}
+
+void word_map_add(word_map_t *map, word_t word, size_t len, unsigned hashv,
+                  size_t count) {
+  word_count_entry_t *w = NULL;
+  HASH_FIND_BYHASHVALUE(hh, map->head, word, len, hashv, w);
+  if (w) {
+    w->count += count;
+  } else {
+    w = create_entry(&map->entries, word, len, count);
+    HASH_ADD_KEYPTR_BYHASHVALUE(hh, map->head, w->word, len, hashv, w);
+  }
+}
+
+void word_map_merge(word_map_t *into, word_map_t *from) {
+  if (!into->head) {
+    word_map_destroy(into);
+    *into = *from;
+    word_map_init(from);
+    return;
+  }
+
+  // Move the entries over rather than copy them. Their memory comes along
+  // with from's arena; the ones folded into an existing entry are left
+  // there unused.
+  word_count_entry_t *current, *tmp, *w;
+  HASH_ITER(hh, from->head, current, tmp) {
+    HASH_DEL(from->head, current);
+    HASH_FIND_BYHASHVALUE(hh, into->head, current->word, current->hh.keylen,
+                          current->hh.hashv, w);
+    if (w) {
+      w->count += current->count;
+    } else {
+      HASH_ADD_KEYPTR_BYHASHVALUE(hh, into->head, current->word,
+                                  current->hh.keylen, current->hh.hashv,
+                                  current);
+    }
+  }
+  arena_merge(&into->entries, &from->entries);
+}
+
+size_t word_map_size(const word_map_t *map) { return HASH_COUNT(map->head); }
+
+void word_map_extract(const word_map_t *map, word_count_t *out) {
+  word_count_entry_t *current, *tmp;
+  HASH_ITER(hh, map->head, current, tmp) {
+    out->word = current->word;
+    out->len = current->hh.keylen;
+    out->count = current->count;
+    out++;
+  }
+}
+
+void word_map_destroy(word_map_t *map) {
+  // Only the bucket array is uthash's own; the entries go with the arena
+  HASH_CLEAR(hh, map->head);
+  arena_destroy(&map->entries);
+}
@@ -11,15 +11,22 @@ Questions to answer at top of client.c:
   Answer: The client ends when `read()` from stdin returns 0 (EOF) or -1 (error). After the loop it closes the socket and exits with `exit(EXIT_SUCCESS)`.
 */
 
+#define _GNU_SOURCE
 #include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
+#include "read_size.h"
+
 #define PORT 8000
-#define BUF_SIZE 64
+// Bytes moved per splice() call in bulk mode
+#define SPLICE_CHUNK (1 << 20)
 #define ADDR "127.0.0.1"
 
 #define handle_error(msg)                                                      \
@@ -28,11 +35,74 @@ Questions to answer at top of client.c:
     exit(EXIT_FAILURE);                                                        \
   } while (0)
 
-int main() {
+// Move everything from `in` to `out` with splice(), so the data never passes
+// through user space. splice() needs a pipe on one side, so unless stdin
+// already is one the data goes through a pipe of our own. Returns the bytes
+// sent, or -1 if splice() can't be used with these descriptors.
+ssize_t splice_all(int in, int out) {
+  int pipefd[2] = {-1, -1};
+  bool in_is_pipe = lseek(in, 0, SEEK_CUR) == -1 && errno == ESPIPE;
+  if (!in_is_pipe && pipe(pipefd) == -1) {
+    handle_error("pipe");
+  }
+
+  ssize_t total = 0;
+  for (;;) {
+    ssize_t n;
+    if (in_is_pipe) {
+      n = splice(in, NULL, out, NULL, SPLICE_CHUNK,
+                 SPLICE_F_MOVE | SPLICE_F_MORE);
+    } else {
+      n = splice(in, NULL, pipefd[1], NULL, SPLICE_CHUNK, SPLICE_F_MOVE);
+      // Drain the pipe into the socket
+      for (ssize_t left = n; left > 0;) {
+        ssize_t m = splice(pipefd[0], NULL, out, NULL, left,
+                           SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (m == -1) {
+          handle_error("splice");
+        }
+        left -= m;
+      }
+    }
+    if (n == 0) {
+      break;
+    }
+    if (n == -1) {
+      if (errno == EINVAL && total == 0) {
+        total = -1; // e.g. a terminal: fall back to read/write
+        break;
+      }
+      handle_error("splice");
+    }
+    total += n;
+  }
+
+  if (!in_is_pipe) {
+    close(pipefd[0]);
+    close(pipefd[1]);
+  }
+  return total;
+}
+
+int main(int argc, char *argv[]) {
   struct sockaddr_in addr;
   int sfd;
   ssize_t num_read;
-  char buf[BUF_SIZE];
+  size_t read_size = BUF_SIZE;
+  char buf[BUF_MAX];
+  bool bulk = false;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "b")) != -1) {
+    switch (opt) {
+    case 'b':
+      bulk = true;
+      break;
+    default:
+      fprintf(stderr, "Usage: %s [-b]\n", argv[0]);
+      exit(EXIT_FAILURE);
+    }
+  }
 
   sfd = socket(AF_INET, SOCK_STREAM, 0);
   if (sfd == -1) {
@@ -51,11 +121,21 @@ int main() {
     handle_error("connect");
   }
 
-  while ((num_read = read(STDIN_FILENO, buf, BUF_SIZE)) > 1) {
+  if (bulk) {
+    ssize_t sent = splice_all(STDIN_FILENO, sfd);
+    if (sent >= 0) {
+      printf("Just sent %zd bytes.\n", sent);
+      close(sfd);
+      exit(EXIT_SUCCESS);
+    }
+  }
+
+  while ((num_read = read(STDIN_FILENO, buf, read_size)) > 1) {
     if (write(sfd, buf, num_read) != num_read) {
       handle_error("write");
     }
     printf("Just sent %zd bytes.\n", num_read);
+    read_size = adapt_read_size(read_size, num_read);
   }
 
   if (num_read == -1) {
@@ -0,0 +1,24 @@
+// Adaptive read sizes for the lab-09 client and server
+#ifndef READ_SIZE_H
+#define READ_SIZE_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+// Reads start at BUF_SIZE bytes and adapt to the data rate up to BUF_MAX
+#define BUF_SIZE 64
+#define BUF_MAX (64 * 1024)
+
+// Double the read size while reads come back full, and halve it again once
+// they come back less than a quarter full
+static inline size_t adapt_read_size(size_t size, ssize_t num_read) {
+  if ((size_t)num_read == size && size < BUF_MAX) {
+    return size * 2;
+  }
+  if ((size_t)num_read < size / 4 && size > BUF_SIZE) {
+    return size / 2;
+  }
+  return size;
+}
+
+#endif
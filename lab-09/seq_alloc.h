@@ -0,0 +1,44 @@
+// Lock-free allocation of message numbers for the lab-09 server
+#ifndef SEQ_ALLOC_H
+#define SEQ_ALLOC_H
+
+#include <stdatomic.h>
+
+// Numbers a thread reserves at once in block mode
+#define SEQ_BLOCK_SIZE 64
+
+// A shared counter on its own cache line
+struct seq_alloc {
+  _Alignas(64) atomic_long next;
+};
+
+// A thread's reserved range [next, end). Zero-initialise before first use.
+struct seq_block {
+  long next;
+  long end;
+};
+
+static inline void seq_init(struct seq_alloc *sa, long first) {
+  atomic_init(&sa->next, first);
+}
+
+// One fetch-add per number: numbers are dense and follow the order in which
+// threads asked for them.
+static inline long seq_next(struct seq_alloc *sa) {
+  return atomic_fetch_add_explicit(&sa->next, 1, memory_order_relaxed);
+}
+
+// Numbers come from the caller's block, and the shared counter is only
+// touched once every SEQ_BLOCK_SIZE calls. Numbers are unique and increase
+// per thread, but threads holding part-used blocks leave gaps, so they are
+// not in global order.
+static inline long seq_next_block(struct seq_alloc *sa, struct seq_block *blk) {
+  if (blk->next == blk->end) {
+    blk->next = atomic_fetch_add_explicit(&sa->next, SEQ_BLOCK_SIZE,
+                                          memory_order_relaxed);
+    blk->end = blk->next + SEQ_BLOCK_SIZE;
+  }
+  return blk->next++;
+}
+
+#endif
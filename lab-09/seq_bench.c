@@ -0,0 +1,158 @@
+// Contention benchmark for message numbering: the original mutex-guarded
+// counter against seq_alloc.h's fetch-add and per-thread block modes.
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "seq_alloc.h"
+
+#define MAX_THREADS 128
+#define NUMBERS_PER_THREAD 200000
+
+#define handle_error(msg)                                                      \
+  do {                                                                         \
+    perror(msg);                                                               \
+    exit(EXIT_FAILURE);                                                        \
+  } while (0)
+
+enum mode { MODE_MUTEX, MODE_ATOMIC, MODE_BLOCK };
+
+static const char *mode_names[] = {"mutex", "atomic", "block"};
+
+struct bench {
+  enum mode mode;
+  pthread_barrier_t start;
+
+  // MODE_MUTEX
+  pthread_mutex_t count_mutex;
+  long total_message_count;
+
+  // MODE_ATOMIC and MODE_BLOCK
+  struct seq_alloc seq;
+};
+
+struct bench_thread {
+  struct bench *bench;
+  long *numbers; // every number this thread was given
+};
+
+static void *run_thread(void *arg) {
+  struct bench_thread *t = (struct bench_thread *)arg;
+  struct bench *b = t->bench;
+  struct seq_block block = {0, 0};
+
+  pthread_barrier_wait(&b->start);
+  for (long i = 0; i < NUMBERS_PER_THREAD; i++) {
+    long n;
+    switch (b->mode) {
+    case MODE_MUTEX:
+      pthread_mutex_lock(&b->count_mutex);
+      n = ++b->total_message_count;
+      pthread_mutex_unlock(&b->count_mutex);
+      break;
+    case MODE_ATOMIC:
+      n = seq_next(&b->seq);
+      break;
+    default:
+      n = seq_next_block(&b->seq, &block);
+      break;
+    }
+    t->numbers[i] = n;
+  }
+  return NULL;
+}
+
+// Every number must have been handed out exactly once
+static bool check_unique(struct bench_thread *threads, int num_threads,
+                         long max) {
+  unsigned char *seen = calloc(max + 1, 1);
+  if (!seen) {
+    handle_error("calloc");
+  }
+  bool ok = true;
+  for (int t = 0; t < num_threads && ok; t++) {
+    for (long i = 0; i < NUMBERS_PER_THREAD; i++) {
+      long n = threads[t].numbers[i];
+      if (n < 1 || n > max || seen[n]) {
+        ok = false;
+        break;
+      }
+      seen[n] = 1;
+    }
+  }
+  free(seen);
+  return ok;
+}
+
+static double run(enum mode mode, int num_threads) {
+  struct bench b;
+  b.mode = mode;
+  pthread_barrier_init(&b.start, NULL, num_threads + 1);
+  pthread_mutex_init(&b.count_mutex, NULL);
+  b.total_message_count = 0;
+  seq_init(&b.seq, 1);
+
+  pthread_t tids[MAX_THREADS];
+  struct bench_thread threads[MAX_THREADS];
+  for (int i = 0; i < num_threads; i++) {
+    threads[i].bench = &b;
+    threads[i].numbers = malloc(NUMBERS_PER_THREAD * sizeof(long));
+    if (!threads[i].numbers) {
+      handle_error("malloc");
+    }
+    if (pthread_create(&tids[i], NULL, run_thread, &threads[i]) != 0) {
+      handle_error("pthread_create");
+    }
+  }
+
+  struct timespec start, end;
+  // Take the start time first: the threads may finish before we wake up
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  pthread_barrier_wait(&b.start);
+  for (int i = 0; i < num_threads; i++) {
+    pthread_join(tids[i], NULL);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  // Block mode may leave part of each thread's last block unused
+  long max = (long)num_threads * NUMBERS_PER_THREAD;
+  if (mode == MODE_BLOCK) {
+    max += (long)num_threads * SEQ_BLOCK_SIZE;
+  }
+  if (!check_unique(threads, num_threads, max)) {
+    fprintf(stderr, "%s: duplicate or out of range number with %d threads\n",
+            mode_names[mode], num_threads);
+    exit(EXIT_FAILURE);
+  }
+
+  for (int i = 0; i < num_threads; i++) {
+    free(threads[i].numbers);
+  }
+  pthread_mutex_destroy(&b.count_mutex);
+  pthread_barrier_destroy(&b.start);
+
+  double secs =
+      (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  return (double)num_threads * NUMBERS_PER_THREAD / secs / 1e6;
+}
+
+int main(void) {
+  printf("%-8s", "threads");
+  for (int m = MODE_MUTEX; m <= MODE_BLOCK; m++) {
+    printf("%12s", mode_names[m]);
+  }
+  printf("   (million numbers/s)\n");
+
+  for (int n = 1; n <= MAX_THREADS; n *= 2) {
+    printf("%-8d", n);
+    for (int m = MODE_MUTEX; m <= MODE_BLOCK; m++) {
+      printf("%12.2f", run(m, n));
+      fflush(stdout);
+    }
+    printf("\n");
+  }
+  return 0;
+}
@@ -1,15 +1,35 @@
 #include <arpa/inet.h>
 #include <errno.h>
+#include <getopt.h>
 #include <pthread.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <time.h>
 #include <unistd.h>
 
-#define BUF_SIZE 64
+#include "read_size.h"
+#include "seq_alloc.h"
+
 #define PORT 8000
 #define LISTEN_BACKLOG 32
+#define DEFAULT_WORKERS 16
+#define DEFAULT_QUEUE_LEN 32
+
+// Logger tuning: bytes of ring buffer per thread, the longest line a record
+// can hold, and how many records the writer gathers into one writev()
+#define LOG_RING_SIZE (1 << 18)
+#define LOG_RECORD_MAX (BUF_MAX + 64)
+#define LOG_BATCH 256
+#define LOG_IDLE_NS 1000000
+#define CACHE_LINE 64
 
 #define handle_error(msg)                                                      \
   do {                                                                         \
@@ -18,27 +38,314 @@
   } while (0)
 
 // Shared counters for: total # messages, and counter of clients (used for
-// assigning client IDs)
-int total_message_count = 0;
-int client_id_counter = 1;
+// assigning client IDs). Both are handed out without taking a lock.
+struct seq_alloc message_seq;
+struct seq_alloc client_id_seq;
 
-// Mutexs to protect above global state.
-pthread_mutex_t count_mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_mutex_t client_id_mutex = PTHREAD_MUTEX_INITIALIZER;
+// With -s block, each worker numbers messages from its own reserved range
+bool use_seq_blocks = false;
+static _Thread_local struct seq_block message_block;
 
 struct client_info {
   int cfd;
   int client_id;
 };
 
-void *handle_client(void *arg) {
-  struct client_info *client = (struct client_info *)arg;
+/*
+ * Asynchronous logger. Every thread that logs owns a single-producer ring
+ * buffer and formats its lines straight into it; a background writer drains
+ * all rings and hands the lines to the kernel in one writev() per batch, so
+ * client threads never touch stdio or make a syscall to log.
+ *
+ * Records tagged with a message number are written strictly in number order
+ * (the writer holds a ring back until the next number turns up); untagged
+ * records go out as soon as they are seen.
+ */
+struct log_record {
+  uint32_t len;  // bytes of text following the header
+  uint32_t skip; // non-zero: padding up to the end of the ring
+  long seq;      // message number, or -1 when unordered
+};
+
+#define LOG_HDR_SIZE sizeof(struct log_record)
+// Records are kept aligned so a header always fits before the ring wraps
+#define LOG_ALIGN(n) (((n) + LOG_HDR_SIZE - 1) & ~(LOG_HDR_SIZE - 1))
+
+struct log_ring {
+  _Alignas(CACHE_LINE) atomic_size_t head; // written by the producer
+  _Alignas(CACHE_LINE) atomic_size_t tail; // written by the writer
+  _Alignas(CACHE_LINE) char data[LOG_RING_SIZE];
+};
+
+struct logger {
+  pthread_mutex_t register_lock;
+  struct log_ring **rings;
+  atomic_size_t num_rings;
+  size_t max_rings;
+  long next_seq; // writer only
+};
+
+static struct logger logger;
+static _Thread_local struct log_ring *thread_ring;
+
+static struct log_ring *log_register(void) {
+  struct log_ring *ring = aligned_alloc(CACHE_LINE, sizeof(struct log_ring));
+  if (!ring) {
+    handle_error("aligned_alloc");
+  }
+  atomic_init(&ring->head, 0);
+  atomic_init(&ring->tail, 0);
+
+  pthread_mutex_lock(&logger.register_lock);
+  size_t n = atomic_load(&logger.num_rings);
+  if (n == logger.max_rings) {
+    fprintf(stderr, "log: too many threads\n");
+    exit(EXIT_FAILURE);
+  }
+  logger.rings[n] = ring;
+  atomic_store_explicit(&logger.num_rings, n + 1, memory_order_release);
+  pthread_mutex_unlock(&logger.register_lock);
+  return ring;
+}
+
+// Wait until the ring has `need` free bytes
+static void log_reserve(struct log_ring *ring, size_t head, size_t need) {
+  while (LOG_RING_SIZE -
+             (head - atomic_load_explicit(&ring->tail, memory_order_acquire)) <
+         need) {
+    sched_yield();
+  }
+}
+
+// Queue one line for output. seq is the message number the line must be
+// ordered by, or -1.
+void log_printf(long seq, const char *fmt, ...) {
+  struct log_ring *ring = thread_ring;
+  if (!ring) {
+    ring = thread_ring = log_register();
+  }
+
+  size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  size_t need = LOG_ALIGN(LOG_HDR_SIZE + LOG_RECORD_MAX);
+  size_t room = LOG_RING_SIZE - (head & (LOG_RING_SIZE - 1));
+  if (room < need) {
+    // Not enough contiguous space before the end: pad to the start
+    log_reserve(ring, head, room);
+    struct log_record *pad =
+        (struct log_record *)&ring->data[head & (LOG_RING_SIZE - 1)];
+    pad->skip = 1;
+    head += room;
+    atomic_store_explicit(&ring->head, head, memory_order_release);
+  }
+  log_reserve(ring, head, need);
+
+  struct log_record *rec =
+      (struct log_record *)&ring->data[head & (LOG_RING_SIZE - 1)];
+  va_list ap;
+  va_start(ap, fmt);
+  int len = vsnprintf((char *)(rec + 1), LOG_RECORD_MAX, fmt, ap);
+  va_end(ap);
+  if (len < 0) {
+    // Still publish the record: the writer waits for every seq in turn
+    len = 0;
+  }
+  if (len >= LOG_RECORD_MAX) {
+    len = LOG_RECORD_MAX - 1;
+  }
+
+  rec->len = len;
+  rec->skip = 0;
+  rec->seq = seq;
+  atomic_store_explicit(&ring->head, head + LOG_ALIGN(LOG_HDR_SIZE + len),
+                        memory_order_release);
+}
 
-  char buf[BUF_SIZE + 1];
+static void write_all(struct iovec *iov, int iovcnt) {
+  while (iovcnt > 0) {
+    ssize_t n = writev(STDOUT_FILENO, iov, iovcnt);
+    if (n == -1) {
+      if (errno == EINTR)
+        continue;
+      perror("log writev");
+      return;
+    }
+    // Step over what was written, possibly ending mid-record
+    while (iovcnt > 0 && (size_t)n >= iov->iov_len) {
+      n -= iov->iov_len;
+      iov++;
+      iovcnt--;
+    }
+    if (iovcnt > 0) {
+      iov->iov_base = (char *)iov->iov_base + n;
+      iov->iov_len -= n;
+    }
+  }
+}
+
+static void *run_log_writer(void *arg) {
+  (void)arg;
+  struct iovec iov[LOG_BATCH];
+  size_t *cursor = calloc(logger.max_rings, sizeof(size_t));
+  if (!cursor) {
+    handle_error("calloc");
+  }
+  const struct timespec idle = {.tv_sec = 0, .tv_nsec = LOG_IDLE_NS};
+
+  for (;;) {
+    size_t num_rings =
+        atomic_load_explicit(&logger.num_rings, memory_order_acquire);
+    int iovcnt = 0;
+    int held = 0; // rings waiting on an earlier message number
+
+    // Keep sweeping while the sweeps turn something up
+    for (int found = 1; found && iovcnt < LOG_BATCH;) {
+      found = 0;
+      held = 0;
+      for (size_t r = 0; r < num_rings && iovcnt < LOG_BATCH; r++) {
+        struct log_ring *ring = logger.rings[r];
+        size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        while (cursor[r] != head && iovcnt < LOG_BATCH) {
+          struct log_record *rec =
+              (struct log_record *)&ring->data[cursor[r] &
+                                               (LOG_RING_SIZE - 1)];
+          if (rec->skip) {
+            cursor[r] += LOG_RING_SIZE - (cursor[r] & (LOG_RING_SIZE - 1));
+            continue;
+          }
+          if (rec->seq != -1 && rec->seq != logger.next_seq) {
+            held++;
+            break;
+          }
+          if (rec->seq != -1) {
+            logger.next_seq++;
+          }
+          iov[iovcnt].iov_base = rec + 1;
+          iov[iovcnt].iov_len = rec->len;
+          iovcnt++;
+          cursor[r] += LOG_ALIGN(LOG_HDR_SIZE + rec->len);
+          found = 1;
+        }
+      }
+    }
+
+    if (iovcnt > 0) {
+      write_all(iov, iovcnt);
+      // Only now hand the space back to the producers
+      for (size_t r = 0; r < num_rings; r++) {
+        atomic_store_explicit(&logger.rings[r]->tail, cursor[r],
+                              memory_order_release);
+      }
+    } else if (held) {
+      // The missing number is being logged right now by another thread
+      sched_yield();
+    } else {
+      nanosleep(&idle, NULL);
+    }
+  }
+  return NULL;
+}
+
+void log_init(size_t max_threads) {
+  pthread_mutex_init(&logger.register_lock, NULL);
+  logger.rings = calloc(max_threads, sizeof(struct log_ring *));
+  if (!logger.rings) {
+    handle_error("calloc");
+  }
+  atomic_init(&logger.num_rings, 0);
+  logger.max_rings = max_threads;
+  logger.next_seq = 1;
+
+  pthread_t tid;
+  if (pthread_create(&tid, NULL, run_log_writer, NULL) != 0) {
+    handle_error("pthread_create");
+  }
+  pthread_detach(tid);
+}
+
+// What the acceptor does with a new client when the handoff queue is full
+enum overload_policy {
+  POLICY_REJECT, // close the new connection straight away
+  POLICY_QUEUE,  // stop accepting until a worker frees a slot
+  POLICY_SHED,   // drop the client that has waited longest, queue the new one
+};
+
+// Bounded FIFO of accepted clients waiting for a worker
+struct client_queue {
+  pthread_mutex_t lock;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+  struct client_info *items;
+  size_t head;
+  size_t len;
+  size_t cap;
+};
+
+void queue_init(struct client_queue *q, size_t cap) {
+  pthread_mutex_init(&q->lock, NULL);
+  pthread_cond_init(&q->not_empty, NULL);
+  pthread_cond_init(&q->not_full, NULL);
+  q->items = malloc(cap * sizeof(struct client_info));
+  if (!q->items) {
+    handle_error("malloc");
+  }
+  q->head = 0;
+  q->len = 0;
+  q->cap = cap;
+}
+
+// Hand a client to the workers. Returns 0 if it was queued, -1 if it was
+// rejected, and 1 if it was queued after dropping the client stored in *shed.
+int queue_push(struct client_queue *q, struct client_info ci,
+               enum overload_policy policy, struct client_info *shed) {
+  int res = 0;
+  pthread_mutex_lock(&q->lock);
+  if (q->len == q->cap) {
+    switch (policy) {
+    case POLICY_REJECT:
+      res = -1;
+      break;
+    case POLICY_QUEUE:
+      while (q->len == q->cap) {
+        pthread_cond_wait(&q->not_full, &q->lock);
+      }
+      break;
+    case POLICY_SHED:
+      *shed = q->items[q->head];
+      q->head = (q->head + 1) % q->cap;
+      q->len--;
+      res = 1;
+      break;
+    }
+  }
+  if (res != -1) {
+    q->items[(q->head + q->len) % q->cap] = ci;
+    q->len++;
+    pthread_cond_signal(&q->not_empty);
+  }
+  pthread_mutex_unlock(&q->lock);
+  return res;
+}
+
+struct client_info queue_pop(struct client_queue *q) {
+  pthread_mutex_lock(&q->lock);
+  while (q->len == 0) {
+    pthread_cond_wait(&q->not_empty, &q->lock);
+  }
+  struct client_info ci = q->items[q->head];
+  q->head = (q->head + 1) % q->cap;
+  q->len--;
+  pthread_cond_signal(&q->not_full);
+  pthread_mutex_unlock(&q->lock);
+  return ci;
+}
+
+// buf must hold BUF_MAX + 1 bytes
+void handle_client(struct client_info *client, char *buf) {
+  size_t read_size = BUF_SIZE;
   ssize_t num_read;
 
   for (;;) {
-    num_read = read(client->cfd, buf, BUF_SIZE);
+    num_read = read(client->cfd, buf, read_size);
     if (num_read == 0) {
       /* client closed connection */
       break;
@@ -49,34 +356,95 @@ void *handle_client(void *arg) {
 
     /* ensure NUL termination for printing */
     if (num_read > 0) {
-      if (num_read > BUF_SIZE)
-        num_read = BUF_SIZE;
       buf[num_read] = '\0';
+      read_size = adapt_read_size(read_size, num_read);
+
+      /* take the next message number without locking */
+      long this_msg_no;
+      if (use_seq_blocks) {
+        this_msg_no = seq_next_block(&message_seq, &message_block);
+      } else {
+        this_msg_no = seq_next(&message_seq);
+      }
 
-      /* update global message count in a thread-safe way */
-      int this_msg_no;
-      pthread_mutex_lock(&count_mutex);
-      total_message_count++;
-      this_msg_no = total_message_count;
-      pthread_mutex_unlock(&count_mutex);
-
-      printf("Msg # %4d; Client ID %d: %s", this_msg_no,
-             client->client_id, buf);
-      if (buf[num_read - 1] != '\n')
-        printf("\n");
-      fflush(stdout);
+      // Block numbers have gaps, so the logger can't wait for each in turn
+      log_printf(use_seq_blocks ? -1 : this_msg_no,
+                 "Msg # %4ld; Client ID %d: %s%s", this_msg_no,
+                 client->client_id, buf,
+                 buf[num_read - 1] != '\n' ? "\n" : "");
     }
   }
 
-  printf("Ending thread for client %d\n", client->client_id);
+  log_printf(-1, "Ending session for client %d\n", client->client_id);
   close(client->cfd);
-  free(client);
+}
+
+// Workers live for the whole run and serve one client at a time
+void *run_worker(void *arg) {
+  struct client_queue *queue = (struct client_queue *)arg;
+  char *buf = malloc(BUF_MAX + 1);
+  if (!buf) {
+    handle_error("malloc");
+  }
+
+  for (;;) {
+    struct client_info ci = queue_pop(queue);
+    handle_client(&ci, buf);
+  }
   return NULL;
 }
 
-int main() {
+static void usage(const char *prog) {
+  fprintf(stderr,
+          "Usage: %s [-w workers] [-q queue length] [-p reject|queue|shed] "
+          "[-s atomic|block]\n",
+          prog);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
   struct sockaddr_in addr;
   int sfd;
+  long num_workers = DEFAULT_WORKERS;
+  long queue_len = DEFAULT_QUEUE_LEN;
+  enum overload_policy policy = POLICY_QUEUE;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "w:q:p:s:")) != -1) {
+    switch (opt) {
+    case 'w':
+      num_workers = strtol(optarg, NULL, 10);
+      break;
+    case 'q':
+      queue_len = strtol(optarg, NULL, 10);
+      break;
+    case 'p':
+      if (strcmp(optarg, "reject") == 0) {
+        policy = POLICY_REJECT;
+      } else if (strcmp(optarg, "queue") == 0) {
+        policy = POLICY_QUEUE;
+      } else if (strcmp(optarg, "shed") == 0) {
+        policy = POLICY_SHED;
+      } else {
+        usage(argv[0]);
+      }
+      break;
+    case 's':
+      if (strcmp(optarg, "atomic") == 0) {
+        use_seq_blocks = false;
+      } else if (strcmp(optarg, "block") == 0) {
+        use_seq_blocks = true;
+      } else {
+        usage(argv[0]);
+      }
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  if (num_workers <= 0 || queue_len <= 0) {
+    usage(argv[0]);
+  }
 
   sfd = socket(AF_INET, SOCK_STREAM, 0);
   if (sfd == -1) {
@@ -102,6 +470,23 @@ int main() {
     handle_error("listen");
   }
 
+  seq_init(&message_seq, 1);
+  seq_init(&client_id_seq, 1);
+
+  // One ring per worker plus one for this thread
+  log_init(num_workers + 1);
+
+  struct client_queue queue;
+  queue_init(&queue, queue_len);
+
+  for (long i = 0; i < num_workers; i++) {
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, run_worker, &queue) != 0) {
+      handle_error("pthread_create");
+    }
+    pthread_detach(tid);
+  }
+
   for (;;) {
     int cfd = accept(sfd, NULL, NULL);
     if (cfd == -1) {
@@ -111,29 +496,25 @@ int main() {
       continue;
     }
 
-    struct client_info *ci = malloc(sizeof(*ci));
-    if (!ci) {
-      perror("malloc");
-      close(cfd);
-      continue;
-    }
-    ci->cfd = cfd;
-
-    pthread_mutex_lock(&client_id_mutex);
-    ci->client_id = client_id_counter++;
-    pthread_mutex_unlock(&client_id_mutex);
+    struct client_info ci = {.cfd = cfd};
 
-    printf("New client created! ID %d on socket FD %d\n", ci->client_id,
-           ci->cfd);
+    ci.client_id = seq_next(&client_id_seq);
 
-    pthread_t tid;
-    if (pthread_create(&tid, NULL, handle_client, ci) != 0) {
-      perror("pthread_create");
-      close(ci->cfd);
-      free(ci);
+    struct client_info shed;
+    int res = queue_push(&queue, ci, policy, &shed);
+    if (res == -1) {
+      log_printf(-1, "Server busy, rejected client %d\n", ci.client_id);
+      close(ci.cfd);
       continue;
     }
-    pthread_detach(tid);
+    if (res == 1) {
+      log_printf(-1, "Server busy, dropped waiting client %d\n",
+                 shed.client_id);
+      close(shed.cfd);
+    }
+
+    log_printf(-1, "New client created! ID %d on socket FD %d\n", ci.client_id,
+               ci.cfd);
   }
 
   if (close(sfd) == -1) {
@@ -141,4 +522,4 @@ int main() {
   }
 
   return 0;
-}
\ No newline at end of file
+}
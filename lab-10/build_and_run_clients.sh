@@ -2,5 +2,6 @@
 
 cd build
 make
-./client & ./client & ./client & ./client
-wait
\ No newline at end of file
+# Four connections sending the five lab words one per second, like four
+# separate clients did
+./client -c 4 -t 4 -n 5 -r 1
\ No newline at end of file
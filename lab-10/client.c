@@ -1,13 +1,34 @@
 #include <arpa/inet.h>
+#include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
 #include <sys/socket.h>
+#include <time.h>
 #include <unistd.h>
 
 #define PORT 8001
 #define BUF_SIZE 1024
 #define ADDR "127.0.0.1"
+// Frames sent per connection per turn in load mode, unless -b says otherwise
+#define DEFAULT_BATCH 64
+#define MAX_BATCH 1024
+#define MAX_EVENTS 256
+// Frames a connection may have unacknowledged in ack mode
+#define ACK_WINDOW 1024
+// Acks read from a connection at once
+#define ACK_READ 64
+// Log-linear histogram: 8 sub-buckets per power of two of nanoseconds
+#define HIST_SUB_BITS 3
+#define HIST_BUCKETS (64 << HIST_SUB_BITS)
 
 #define handle_error(msg)                                                      \
   do {                                                                         \
@@ -20,24 +41,130 @@
 static const char *messages[NUM_MSG] = {"Hello", "Apple", "Car", "Green",
                                         "Dog"};
 
-int main() {
-  int sfd = socket(AF_INET, SOCK_STREAM, 0);
-  if (sfd == -1) {
-    handle_error("socket");
-  }
+// What `server -a` sends back for every frame. Both fields are big-endian.
+struct msg_ack {
+  uint64_t seq;     // frame number within the connection, from 0
+  uint64_t recv_ns; // server CLOCK_MONOTONIC time the frame was completed
+};
+
+// Load mode settings, enabled with -n
+struct load_opts {
+  long count;      // messages per connection
+  size_t size;     // payload bytes per message, the frame is still BUF_SIZE
+  double rate;     // target messages/sec per connection, 0 for no limit
+  size_t batch;    // most frames written per connection per turn
+  long conns;      // connections to open
+  long threads;    // threads sharing the connections
+  double ramp_sec; // connections are opened evenly over this long
+  uint16_t port;
+  bool ack; // the server acknowledges every frame (server -a)
+};
+
+struct histogram {
+  uint64_t buckets[HIST_BUCKETS];
+  uint64_t count;
+  uint64_t max;
+};
+
+struct conn {
+  int fd;
+  long id;
+  long sent;          // frames fully written
+  size_t batch_len;   // frames in the batch being written
+  size_t batch_off;   // bytes of that batch already written
+  uint64_t due_ns;    // when the next batch may start (paced mode)
+  uint64_t batch_ns;  // when the current batch started
+  uint64_t connect_ns;
+  uint64_t done_ns;
+  bool armed; // registered for EPOLLOUT
+  struct histogram write_lat;
+
+  // Ack mode only
+  long acked;
+  uint64_t *send_ns; // send time of frame i at [i % ACK_WINDOW]
+  size_t ack_fill;   // bytes in ack_buf
+  char ack_buf[ACK_READ * sizeof(struct msg_ack)];
+  struct histogram rtt;      // frame written -> ack read
+  struct histogram recv_lat; // frame written -> server completed it
+};
+
+struct load_thread {
+  pthread_t tid;
+  long first, num_conns; // conns[first .. first + num_conns)
+  struct load *load;
+};
 
+struct load {
+  struct load_opts opts;
   struct sockaddr_in addr;
-  memset(&addr, 0, sizeof(struct sockaddr_in));
-  addr.sin_family = AF_INET;
-  addr.sin_port = htons(PORT);
-  if (inet_pton(AF_INET, ADDR, &addr.sin_addr) <= 0) {
-    handle_error("inet_pton");
+  struct conn *conns;
+  const char *frames; // frames for any batch, shared read-only by everybody
+  pthread_barrier_t start;
+  uint64_t open_ns;  // when the ramp-up began
+  uint64_t start_ns; // when sending began
+};
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void sleep_until_ns(uint64_t deadline) {
+  struct timespec ts = {.tv_sec = deadline / 1000000000,
+                        .tv_nsec = deadline % 1000000000};
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
   }
+}
 
-  if (connect(sfd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
-    handle_error("connect");
+static void hist_add(struct histogram *h, uint64_t v) {
+  size_t idx = v;
+  if (v >= (1 << HIST_SUB_BITS)) {
+    int exp = 63 - __builtin_clzll(v);
+    size_t sub = (v >> (exp - HIST_SUB_BITS)) & ((1 << HIST_SUB_BITS) - 1);
+    idx = ((size_t)(exp - HIST_SUB_BITS + 1) << HIST_SUB_BITS) + sub;
   }
+  h->buckets[idx]++;
+  h->count++;
+  if (v > h->max) {
+    h->max = v;
+  }
+}
 
+static void hist_merge(struct histogram *dst, const struct histogram *src) {
+  for (size_t i = 0; i < HIST_BUCKETS; i++) {
+    dst->buckets[i] += src->buckets[i];
+  }
+  dst->count += src->count;
+  if (src->max > dst->max) {
+    dst->max = src->max;
+  }
+}
+
+// Lower bound of the bucket holding the p-th percentile, in microseconds
+static double hist_percentile_us(const struct histogram *h, double p) {
+  if (h->count == 0) {
+    return 0;
+  }
+  uint64_t rank = (uint64_t)(p / 100 * (h->count - 1)) + 1;
+  uint64_t seen = 0;
+  for (size_t idx = 0; idx < HIST_BUCKETS; idx++) {
+    seen += h->buckets[idx];
+    if (seen >= rank) {
+      if (idx < (1 << HIST_SUB_BITS)) {
+        return idx / 1e3;
+      }
+      int exp = (idx >> HIST_SUB_BITS) + HIST_SUB_BITS - 1;
+      uint64_t sub = idx & ((1 << HIST_SUB_BITS) - 1);
+      uint64_t v = (1ULL << exp) | (sub << (exp - HIST_SUB_BITS));
+      return v / 1e3;
+    }
+  }
+  return h->max / 1e3;
+}
+
+// The original lab client: five words, one per second
+static void send_messages(int sfd) {
   char buf[BUF_SIZE];
   for (int i = 0; i < NUM_MSG; i++) {
     sleep(1);
@@ -51,6 +178,501 @@ int main() {
       printf("Sent: %s\n", messages[i]);
     }
   }
+}
+
+// Frames cycling through the lab words, each padded with 'x' to the payload
+// size. The rest of every frame stays zeroed so the server sees a C string.
+// There are NUM_MSG - 1 spare frames so a batch can start on any word.
+static char *build_frames(const struct load_opts *opts) {
+  size_t num_frames = opts->batch + NUM_MSG - 1;
+  char *frames = calloc(num_frames, BUF_SIZE);
+  if (frames == NULL) {
+    handle_error("calloc");
+  }
+  for (size_t i = 0; i < num_frames; i++) {
+    char *frame = frames + i * BUF_SIZE;
+    strncpy(frame, messages[i % NUM_MSG], BUF_SIZE - 1);
+    size_t len = strlen(frame);
+    if (len < opts->size) {
+      memset(frame + len, 'x', opts->size - len);
+    }
+  }
+  return frames;
+}
+
+static void set_epoll(int epfd, struct conn *c, bool armed, bool ack) {
+  struct epoll_event ev = {
+      .events = (armed ? EPOLLOUT : 0) | (ack ? EPOLLIN : 0),
+      .data.ptr = c,
+  };
+  if (epoll_ctl(epfd, EPOLL_CTL_MOD, c->fd, &ev) == -1) {
+    handle_error("epoll_ctl");
+  }
+  c->armed = armed;
+}
+
+// Frames the connection may send right now
+static size_t frames_due(const struct load *load, const struct conn *c,
+                         uint64_t now) {
+  const struct load_opts *opts = &load->opts;
+  long due = opts->count - c->sent;
+  if (opts->rate > 0) {
+    long allowed = (long)((now - load->start_ns) / 1e9 * opts->rate) + 1;
+    if (allowed - c->sent < due) {
+      due = allowed - c->sent;
+    }
+  }
+  if (opts->ack && ACK_WINDOW - (c->sent - c->acked) < due) {
+    due = ACK_WINDOW - (c->sent - c->acked);
+  }
+  if (due > (long)opts->batch) {
+    due = opts->batch;
+  }
+  return due > 0 ? due : 0;
+}
+
+static uint64_t next_due_ns(const struct load *load, const struct conn *c) {
+  return load->start_ns + (uint64_t)(c->sent / load->opts.rate * 1e9);
+}
+
+static bool conn_done(const struct load *load, const struct conn *c) {
+  return c->sent == load->opts.count &&
+         (!load->opts.ack || c->acked == load->opts.count);
+}
+
+// Write as much of the connection's batch as the socket takes
+static void conn_write(struct load *load, struct conn *c, uint64_t now) {
+  if (c->batch_len == 0) {
+    c->batch_len = frames_due(load, c, now);
+    c->batch_off = 0;
+    c->batch_ns = now;
+    if (c->batch_len == 0) {
+      return;
+    }
+  }
+
+  // Carry on with the word after the last one this connection sent
+  const char *batch = load->frames + (c->sent % NUM_MSG) * BUF_SIZE;
+  size_t total = c->batch_len * BUF_SIZE;
+  ssize_t n = write(c->fd, batch + c->batch_off, total - c->batch_off);
+  if (n == -1) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+      return;
+    }
+    handle_error("write");
+  }
+
+  // Frames that went out with this write were sent no earlier than `now`
+  if (load->opts.ack) {
+    for (size_t f = c->batch_off / BUF_SIZE; f < (c->batch_off + n) / BUF_SIZE;
+         f++) {
+      c->send_ns[(c->sent + f) % ACK_WINDOW] = now;
+    }
+  }
+  c->batch_off += n;
+  if (c->batch_off < total) {
+    return;
+  }
+
+  uint64_t end = now_ns();
+  hist_add(&c->write_lat, end - c->batch_ns);
+  c->sent += c->batch_len;
+  c->batch_len = 0;
+  if (conn_done(load, c)) {
+    c->done_ns = end;
+  }
+}
+
+// Read the server's acks and time the frames they acknowledge
+static void conn_read_acks(struct load *load, struct conn *c) {
+  ssize_t n = read(c->fd, c->ack_buf + c->ack_fill,
+                   sizeof(c->ack_buf) - c->ack_fill);
+  if (n == -1) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+      return;
+    }
+    handle_error("read");
+  } else if (n == 0) {
+    fprintf(stderr, "connection %ld: server closed after %ld acks\n", c->id,
+            c->acked);
+    exit(EXIT_FAILURE);
+  }
+  c->ack_fill += n;
+
+  uint64_t now = now_ns();
+  size_t used = 0;
+  for (; c->ack_fill - used >= sizeof(struct msg_ack);
+       used += sizeof(struct msg_ack)) {
+    struct msg_ack a;
+    memcpy(&a, c->ack_buf + used, sizeof(a));
+    uint64_t seq = be64toh(a.seq);
+    uint64_t recv_ns = be64toh(a.recv_ns);
+    if (seq != (uint64_t)c->acked) {
+      fprintf(stderr, "connection %ld: expected ack %ld, got %lu\n", c->id,
+              c->acked, (unsigned long)seq);
+      exit(EXIT_FAILURE);
+    }
+
+    uint64_t sent = c->send_ns[seq % ACK_WINDOW];
+    hist_add(&c->rtt, now - sent);
+    hist_add(&c->recv_lat, recv_ns > sent ? recv_ns - sent : 0);
+    c->acked++;
+  }
+  memmove(c->ack_buf, c->ack_buf + used, c->ack_fill - used);
+  c->ack_fill -= used;
+
+  if (conn_done(load, c)) {
+    c->done_ns = now;
+  }
+}
+
+// Watch for writability only while the connection has something it may send.
+// A connection held back by its rate gets a due time; one held back by the
+// ack window is woken by its next ack instead.
+static void update_interest(int epfd, struct load *load, struct conn *c,
+                            uint64_t now) {
+  bool want = c->batch_len > 0 || frames_due(load, c, now) > 0;
+  if (want != c->armed) {
+    set_epoll(epfd, c, want, load->opts.ack);
+  }
+  c->due_ns = UINT64_MAX;
+  if (!want && load->opts.rate > 0 && c->sent < load->opts.count) {
+    uint64_t due = next_due_ns(load, c);
+    if (due > now) {
+      c->due_ns = due;
+    }
+  }
+}
+
+static void open_conn(struct load *load, struct conn *c) {
+  // Spread connection attempts evenly over the ramp-up period
+  if (load->opts.ramp_sec > 0) {
+    sleep_until_ns(load->open_ns + (uint64_t)(load->opts.ramp_sec * 1e9 *
+                                              c->id / load->opts.conns));
+  }
+
+  c->fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (c->fd == -1) {
+    handle_error("socket");
+  }
+  uint64_t start = now_ns();
+  if (connect(c->fd, (struct sockaddr *)&load->addr, sizeof(load->addr)) ==
+      -1) {
+    handle_error("connect");
+  }
+  c->connect_ns = now_ns() - start;
+
+  int flags = fcntl(c->fd, F_GETFL, 0);
+  if (flags == -1 || fcntl(c->fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+    handle_error("fcntl");
+  }
+}
+
+// Each thread opens its share of the connections, waits for everybody else,
+// then drives its connections from one epoll loop
+static void *run_load_thread(void *arg) {
+  struct load_thread *t = (struct load_thread *)arg;
+  struct load *load = t->load;
+  struct conn *conns = &load->conns[t->first];
+
+  for (long i = 0; i < t->num_conns; i++) {
+    open_conn(load, &conns[i]);
+  }
+
+  int epfd = epoll_create1(0);
+  if (epfd == -1) {
+    handle_error("epoll_create1");
+  }
+  uint32_t events_in = load->opts.ack ? EPOLLIN : 0;
+  for (long i = 0; i < t->num_conns; i++) {
+    struct epoll_event ev = {.events = EPOLLOUT | events_in,
+                             .data.ptr = &conns[i]};
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, conns[i].fd, &ev) == -1) {
+      handle_error("epoll_ctl");
+    }
+    conns[i].armed = true;
+    conns[i].due_ns = UINT64_MAX;
+  }
+
+  pthread_barrier_wait(&load->start);
+  // main() sets start_ns, then meets us at the barrier again
+  pthread_barrier_wait(&load->start);
+
+  long active = t->num_conns;
+  struct epoll_event events[MAX_EVENTS];
+  while (active > 0) {
+    // Re-arm paced connections whose next batch is due
+    int timeout_ms = -1;
+    if (load->opts.rate > 0) {
+      uint64_t now = now_ns();
+      uint64_t next = UINT64_MAX;
+      for (long i = 0; i < t->num_conns; i++) {
+        struct conn *c = &conns[i];
+        if (c->armed || c->done_ns != 0 || c->due_ns == UINT64_MAX) {
+          continue;
+        }
+        if (c->due_ns <= now) {
+          update_interest(epfd, load, c, now);
+        } else if (c->due_ns < next) {
+          next = c->due_ns;
+        }
+      }
+      if (next != UINT64_MAX) {
+        timeout_ms = (next - now + 999999) / 1000000;
+      }
+    }
+
+    int n = epoll_wait(epfd, events, MAX_EVENTS, timeout_ms);
+    if (n == -1) {
+      if (errno == EINTR)
+        continue;
+      handle_error("epoll_wait");
+    }
+
+    uint64_t now = now_ns();
+    for (int i = 0; i < n; i++) {
+      struct conn *c = events[i].data.ptr;
+      if (load->opts.ack &&
+          (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))) {
+        conn_read_acks(load, c);
+      }
+      if (events[i].events & EPOLLOUT) {
+        conn_write(load, c, now);
+      }
+
+      if (c->done_ns != 0) {
+        epoll_ctl(epfd, EPOLL_CTL_DEL, c->fd, NULL);
+        active--;
+      } else {
+        update_interest(epfd, load, c, now);
+      }
+    }
+  }
+
+  close(epfd);
+  for (long i = 0; i < t->num_conns; i++) {
+    close(conns[i].fd);
+  }
+  return NULL;
+}
+
+// Thousands of connections need more descriptors than the default soft limit
+static void raise_fd_limit(long conns) {
+  struct rlimit rl;
+  if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < (rlim_t)conns + 64) {
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+  }
+}
+
+static void print_latency(const char *name, const struct histogram *h) {
+  printf("%-22s p50 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.1f us\n", name,
+         hist_percentile_us(h, 50), hist_percentile_us(h, 99),
+         hist_percentile_us(h, 99.9), h->max / 1e3);
+}
+
+static void report(const struct load *load) {
+  const struct load_opts *opts = &load->opts;
+  // Too big for the stack with ack mode's extra histograms
+  struct histogram *all = calloc(4, sizeof(struct histogram));
+  if (all == NULL) {
+    handle_error("calloc");
+  }
+  struct histogram *connect_lat = &all[0];
+  struct histogram *write_lat = &all[1];
+  struct histogram *rtt = &all[2];
+  struct histogram *recv_lat = &all[3];
+  uint64_t end = load->start_ns;
+  long total = 0;
+
+  printf("%-8s%12s%12s%14s%14s%14s", "conn", "messages", "msg/s",
+         "connect us", "write p50 us", "write p99 us");
+  if (opts->ack) {
+    printf("%14s%14s", "rtt p50 us", "rtt p99 us");
+  }
+  printf("\n");
+  for (long i = 0; i < opts->conns; i++) {
+    const struct conn *c = &load->conns[i];
+    double secs = (c->done_ns - load->start_ns) / 1e9;
+    printf("%-8ld%12ld%12.0f%14.1f%14.1f%14.1f", c->id, c->sent,
+           c->sent / secs, c->connect_ns / 1e3,
+           hist_percentile_us(&c->write_lat, 50),
+           hist_percentile_us(&c->write_lat, 99));
+    if (opts->ack) {
+      printf("%14.1f%14.1f", hist_percentile_us(&c->rtt, 50),
+             hist_percentile_us(&c->rtt, 99));
+    }
+    printf("\n");
+
+    hist_add(connect_lat, c->connect_ns);
+    hist_merge(write_lat, &c->write_lat);
+    hist_merge(rtt, &c->rtt);
+    hist_merge(recv_lat, &c->recv_lat);
+    total += c->sent;
+    if (c->done_ns > end) {
+      end = c->done_ns;
+    }
+  }
+
+  double secs = (end - load->start_ns) / 1e9;
+  printf("Total: %ld messages over %ld connections in %.3f s: %.0f msg/s, "
+         "%.2f MB/s\n",
+         total, opts->conns, secs, total / secs,
+         total * (double)BUF_SIZE / secs / 1e6);
+  print_latency("Connect latency:", connect_lat);
+  print_latency("Write latency:", write_lat);
+  if (opts->ack) {
+    print_latency("Round trip:", rtt);
+    print_latency("Send to server recv:", recv_lat);
+  }
+  free(all);
+}
+
+static void run_load(const struct load_opts *opts, struct sockaddr_in addr) {
+  struct load load = {.opts = *opts, .addr = addr};
+  load.addr.sin_port = htons(opts->port);
+  load.frames = build_frames(opts);
+  load.conns = calloc(opts->conns, sizeof(struct conn));
+  struct load_thread *threads = calloc(opts->threads, sizeof(*threads));
+  if (load.conns == NULL || threads == NULL) {
+    handle_error("calloc");
+  }
+  for (long i = 0; i < opts->conns; i++) {
+    load.conns[i].id = i;
+    if (opts->ack) {
+      load.conns[i].send_ns = malloc(ACK_WINDOW * sizeof(uint64_t));
+      if (load.conns[i].send_ns == NULL) {
+        handle_error("malloc");
+      }
+    }
+  }
+  raise_fd_limit(opts->conns);
+  pthread_barrier_init(&load.start, NULL, opts->threads + 1);
+
+  // Split the connections into contiguous, nearly equal shares
+  load.open_ns = now_ns();
+  for (long i = 0; i < opts->threads; i++) {
+    threads[i].load = &load;
+    threads[i].first = opts->conns * i / opts->threads;
+    threads[i].num_conns = opts->conns * (i + 1) / opts->threads -
+                           threads[i].first;
+    if (pthread_create(&threads[i].tid, NULL, run_load_thread, &threads[i]) !=
+        0) {
+      handle_error("pthread_create");
+    }
+  }
+
+  // Start everybody together once every connection is open
+  pthread_barrier_wait(&load.start);
+  load.start_ns = now_ns();
+  pthread_barrier_wait(&load.start);
+
+  for (long i = 0; i < opts->threads; i++) {
+    pthread_join(threads[i].tid, NULL);
+  }
+
+  report(&load);
+
+  pthread_barrier_destroy(&load.start);
+  for (long i = 0; i < opts->conns; i++) {
+    free(load.conns[i].send_ns);
+  }
+  free(threads);
+  free(load.conns);
+  free((void *)load.frames);
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+          "Usage: %s [-n messages per connection [-c connections] "
+          "[-t threads] [-R ramp-up sec] [-s payload size] "
+          "[-r messages/sec per connection] [-b frames per write] "
+          "[-p port] [-A]]\n"
+          "  -A  time round trips using the acks of 'server -a'\n",
+          prog);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+  struct load_opts opts = {
+      .count = 0,
+      .size = 0,
+      .rate = 0,
+      .batch = DEFAULT_BATCH,
+      .conns = 1,
+      .threads = 1,
+      .ramp_sec = 0,
+      .port = PORT,
+      .ack = false,
+  };
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:s:r:b:c:t:R:p:A")) != -1) {
+    switch (opt) {
+    case 'n':
+      opts.count = strtol(optarg, NULL, 10);
+      break;
+    case 's':
+      opts.size = strtoul(optarg, NULL, 10);
+      break;
+    case 'r':
+      opts.rate = strtod(optarg, NULL);
+      break;
+    case 'b':
+      opts.batch = strtoul(optarg, NULL, 10);
+      break;
+    case 'c':
+      opts.conns = strtol(optarg, NULL, 10);
+      break;
+    case 't':
+      opts.threads = strtol(optarg, NULL, 10);
+      break;
+    case 'R':
+      opts.ramp_sec = strtod(optarg, NULL);
+      break;
+    case 'p':
+      opts.port = strtoul(optarg, NULL, 10);
+      break;
+    case 'A':
+      opts.ack = true;
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  // The payload has to leave room for the NUL the server prints up to
+  if (opts.count < 0 || opts.size >= BUF_SIZE || opts.rate < 0 ||
+      opts.batch == 0 || opts.batch > MAX_BATCH || opts.conns <= 0 ||
+      opts.threads <= 0 || opts.ramp_sec < 0) {
+    usage(argv[0]);
+  }
+  if (opts.threads > opts.conns) {
+    opts.threads = opts.conns;
+  }
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(struct sockaddr_in));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(PORT);
+  if (inet_pton(AF_INET, ADDR, &addr.sin_addr) <= 0) {
+    handle_error("inet_pton");
+  }
+
+  if (opts.count > 0) {
+    run_load(&opts, addr);
+    exit(EXIT_SUCCESS);
+  }
+
+  int sfd = socket(AF_INET, SOCK_STREAM, 0);
+  if (sfd == -1) {
+    handle_error("socket");
+  }
+
+  if (connect(sfd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+    handle_error("connect");
+  }
+
+  send_messages(sfd);
 
   exit(EXIT_SUCCESS);
-}
\ No newline at end of file
+}
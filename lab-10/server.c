@@ -6,13 +6,13 @@ Questions to answer at top of server.c:
     - The client is sending a series of string messages: "Hello", "Apple", "Car", "Green", and "Dog".
 Understanding the Server:
 1. Explain the argument that the `run_acceptor` thread is passed as an argument.
-    - The `run_acceptor` thread is passed a pointer to an `acceptor_args` structure, which contains an atomic boolean `run` to control the thread's execution, a pointer to a `list_handle` for storing received messages, and a pointer to a mutex `list_lock` for synchronizing access to the message list.
+    - The `run_acceptor` thread is passed a pointer to an `acceptor_args` structure, which contains an atomic boolean `run` to control the thread's execution, the number of worker threads to start, and a pointer to the array of per-worker `msg_sink`s the workers store received messages in.
 2. How are received messages stored?
-    - Received messages are stored in a linked list, where each node contains the message data and a pointer to the next node. The list is managed using a `list_handle` structure that keeps track of the last node and the count of messages.
+    - Received messages are stored in linked lists, where each node contains the message data, its receive timestamp and a pointer to the next node. Every worker appends to its own list (a `msg_sink`, padded to a cache line), so no locking is needed while receiving; `collect_all` merges the lists by receive time at the end.
 3. What does `main()` do with the received messages?
     - The `main()` function waits until enough messages are received, then stops the acceptor thread, collects all messages from the linked list, prints them, and verifies that all messages were collected successfully.
 4. How are threads used in this sample code?
-    - Threads are used to handle multiple clients concurrently. The `run_acceptor` thread listens for incoming client connections and spawns a new `run_client` thread for each connected client to handle message reception without blocking the acceptor.
+    - Threads are used to handle multiple clients concurrently. The `run_acceptor` thread listens for incoming client connections and hands each one to a fixed pool of worker threads (one per core by default). Workers take turns servicing the connections in their own queue and steal connections from busier workers when they run dry, so any number of clients can be served without one thread per client.
 Explain the use of non-blocking sockets in this lab.
 1. How are sockets made non-blocking?
    - By using fcntl() with the O_NONBLOCK flag.
@@ -23,8 +23,10 @@ Explain the use of non-blocking sockets in this lab.
 */
 
 #include <arpa/inet.h>
+#include <endian.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <getopt.h>
 #include <pthread.h>
 #include <stdatomic.h>
 #include <stdbool.h>
@@ -32,12 +34,29 @@ Explain the use of non-blocking sockets in this lab.
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
 #include <unistd.h>
 #define BUF_SIZE 1024
 #define PORT 8001
-#define LISTEN_BACKLOG 32
-#define MAX_CLIENTS 4
+#define LISTEN_BACKLOG SOMAXCONN
+#define DEFAULT_NUM_CLIENTS 4
 #define NUM_MSG_PER_CLIENT 5
+// Initial capacity of each worker's connection queue (grows on demand)
+#define DEQUE_INIT_CAP 64
+// Frames read from one connection before moving on to the next one
+#define MAX_FRAMES_PER_TURN 16
+// How long a worker naps when none of its connections had data
+#define IDLE_SLEEP_NS 50000
+// How long main() waits between checks of the message count
+#define POLL_SLEEP_NS 1000000
+#define CACHE_LINE 64
+// Receive buffers each worker's pool allocates at once
+#define POOL_SLAB_BUFS 256
+// Acks a connection may have waiting for the client to read them
+#define ACK_BUF_SIZE (4 * MAX_FRAMES_PER_TURN * sizeof(struct msg_ack))
+// How long a closing connection's last acks may block on a full socket
+#define ACK_DRAIN_TIMEOUT_US 100000
 
 #define handle_error(msg)                                                      \
   do {                                                                         \
@@ -48,26 +67,99 @@ Explain the use of non-blocking sockets in this lab.
 struct list_node {
   struct list_node *next;
   void *data;
+  uint64_t recv_ns; // CLOCK_MONOTONIC time the frame was completed
+  uint64_t seq;     // frame number within its connection, breaks ties
 };
 
 struct list_handle {
   struct list_node *last;
-  volatile uint32_t count;
+  atomic_uint count; // only written by the owning worker
 };
 
-struct client_args {
-  atomic_bool run;
+// Sent back for every frame in ack mode (-a). Both fields are big-endian.
+struct msg_ack {
+  uint64_t seq;     // frame number within the connection, from 0
+  uint64_t recv_ns; // CLOCK_MONOTONIC time the frame was completed
+};
+
+struct buf_pool;
+
+// A receive buffer. The socket is read straight into `data`, and once a frame
+// is complete the buffer is linked into a sink through its embedded node, so
+// the payload is never copied.
+struct msg_buf {
+  struct list_node node; // must stay first, free lists link through it
+  struct buf_pool *owner;
+  char data[BUF_SIZE];
+};
 
+struct pool_slab {
+  struct pool_slab *next;
+  struct msg_buf bufs[POOL_SLAB_BUFS];
+};
+
+// Buffers are allocated in slabs up front and recycled through a free list.
+// A pool is only touched by its worker while the server runs.
+struct buf_pool {
+  struct msg_buf *free_list;
+  struct pool_slab *slabs;
+};
+
+// Messages received by one worker, in the order it received them. Each sink
+// sits on its own cache line so workers never contend while appending.
+struct msg_sink {
+  _Alignas(CACHE_LINE) struct list_node head;
+  struct list_handle list;
+  struct buf_pool pool;
+};
+
+// One accepted client. Messages are fixed BUF_SIZE frames, so a partially read
+// frame is kept in `rx` and finished by whichever worker services it next.
+struct conn {
   int cfd;
-  struct list_handle *list_handle;
-  pthread_mutex_t *list_lock;
+  size_t filled;
+  uint64_t frames;
+  struct msg_buf *rx;
+  size_t ack_len; // bytes of acks not yet written
+  char acks[ACK_BUF_SIZE];
+};
+
+// Per-worker queue of connections, kept as a growable ring buffer. The owner
+// takes connections from the head and puts them back at the tail once
+// serviced (round robin); idle workers steal from the tail.
+struct conn_deque {
+  pthread_mutex_t lock;
+  struct conn **items;
+  size_t head;
+  size_t len;
+  size_t cap;
+};
+
+struct worker_pool;
+
+struct worker {
+  pthread_t thread;
+  size_t id;
+  struct conn_deque deque;
+  struct msg_sink *sink;
+  struct worker_pool *pool;
+};
+
+struct worker_pool {
+  atomic_bool run;
+
+  bool ack;
+  size_t num_workers;
+  struct worker *workers;
 };
 
 struct acceptor_args {
   atomic_bool run;
 
-  struct list_handle *list_handle;
-  pthread_mutex_t *list_lock;
+  bool ack; // acknowledge every frame
+
+  size_t num_workers;
+  struct msg_sink *sinks; // one per worker
 };
 
 int init_server_socket() {
@@ -78,6 +170,13 @@ int init_server_socket() {
     handle_error("socket");
   }
 
+  // Benchmark runs restart the server often; don't wait out TIME_WAIT
+  int optval = 1;
+  if (setsockopt(sfd, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval)) ==
+      -1) {
+    handle_error("setsockopt");
+  }
+
   memset(&addr, 0, sizeof(struct sockaddr_in));
   addr.sin_family = AF_INET;
   addr.sin_port = htons(PORT);
@@ -111,105 +210,470 @@ void add_to_list(struct list_handle *list_handle, struct list_node *new_node) {
   struct list_node *last_node = list_handle->last;
   last_node->next = new_node;
   list_handle->last = last_node->next;
-  list_handle->count++;
+  // Single writer, so a plain load + store is enough; release publishes the
+  // node to whoever reads the count
+  unsigned count =
+      atomic_load_explicit(&list_handle->count, memory_order_relaxed);
+  atomic_store_explicit(&list_handle->count, count + 1, memory_order_release);
+}
+
+static void pool_grow(struct buf_pool *pool) {
+  struct pool_slab *slab = malloc(sizeof(struct pool_slab));
+  if (slab == NULL) {
+    handle_error("malloc");
+  }
+  slab->next = pool->slabs;
+  pool->slabs = slab;
+
+  for (size_t i = 0; i < POOL_SLAB_BUFS; i++) {
+    slab->bufs[i].node.next = (struct list_node *)pool->free_list;
+    pool->free_list = &slab->bufs[i];
+  }
 }
 
-int collect_all(struct list_node head) {
-  struct list_node *node = head.next; // get first node after head
+struct msg_buf *pool_acquire(struct buf_pool *pool) {
+  if (pool->free_list == NULL) {
+    pool_grow(pool);
+  }
+  struct msg_buf *buf = pool->free_list;
+  pool->free_list = (struct msg_buf *)buf->node.next;
+  buf->owner = pool;
+  return buf;
+}
+
+void pool_release(struct buf_pool *pool, struct msg_buf *buf) {
+  buf->node.next = (struct list_node *)pool->free_list;
+  pool->free_list = buf;
+}
+
+void init_sinks(struct msg_sink *sinks, size_t num_sinks) {
+  for (size_t i = 0; i < num_sinks; i++) {
+    sinks[i].head.next = NULL;
+    sinks[i].head.data = NULL;
+    sinks[i].list.last = &sinks[i].head;
+    atomic_init(&sinks[i].list.count, 0);
+    sinks[i].pool.free_list = NULL;
+    sinks[i].pool.slabs = NULL;
+    pool_grow(&sinks[i].pool);
+  }
+}
+
+// Frees the buffer pools; every buffer must be back in a pool by now
+void destroy_sinks(struct msg_sink *sinks, size_t num_sinks) {
+  for (size_t i = 0; i < num_sinks; i++) {
+    struct pool_slab *slab = sinks[i].pool.slabs;
+    while (slab != NULL) {
+      struct pool_slab *next = slab->next;
+      free(slab);
+      slab = next;
+    }
+  }
+}
+
+uint32_t count_all(struct msg_sink *sinks, size_t num_sinks) {
   uint32_t total = 0;
+  for (size_t i = 0; i < num_sinks; i++) {
+    total += atomic_load_explicit(&sinks[i].list.count, memory_order_acquire);
+  }
+  return total;
+}
 
-  while (node != NULL) {
+static bool node_before(const struct list_node *a, const struct list_node *b) {
+  if (a->recv_ns != b->recv_ns) {
+    return a->recv_ns < b->recv_ns;
+  }
+  return a->seq < b->seq;
+}
+
+// Restore the min-heap property below index i
+static void sift_down(struct list_node **heap, size_t len, size_t i) {
+  for (;;) {
+    size_t min = i;
+    size_t left = 2 * i + 1;
+    size_t right = left + 1;
+    if (left < len && node_before(heap[left], heap[min])) {
+      min = left;
+    }
+    if (right < len && node_before(heap[right], heap[min])) {
+      min = right;
+    }
+    if (min == i) {
+      return;
+    }
+    struct list_node *tmp = heap[i];
+    heap[i] = heap[min];
+    heap[min] = tmp;
+    i = min;
+  }
+}
+
+// Each sink is already in receive order, so a k-way merge over the sink heads
+// yields every message in global receive order. Consumed buffers go back to
+// the pool they were taken from.
+int collect_all(struct msg_sink *sinks, size_t num_sinks) {
+  struct list_node **heap = malloc(num_sinks * sizeof(struct list_node *));
+  if (heap == NULL) {
+    handle_error("malloc");
+  }
+
+  size_t len = 0;
+  for (size_t i = 0; i < num_sinks; i++) {
+    if (sinks[i].head.next != NULL) {
+      heap[len++] = sinks[i].head.next; // get first node after head
+    }
+  }
+  for (size_t i = len / 2; i-- > 0;) {
+    sift_down(heap, len, i);
+  }
+
+  uint32_t total = 0;
+  while (len > 0) {
+    struct list_node *node = heap[0];
     printf("Collected: %s\n", (char *)node->data);
     total++;
 
-    // Free node and advance to next item
-    struct list_node *next = node->next;
-    free(node->data);
-    free(node);
-    node = next;
+    // Replace the node with its successor from the same sink
+    if (node->next != NULL) {
+      heap[0] = node->next;
+    } else {
+      heap[0] = heap[--len];
+    }
+    sift_down(heap, len, 0);
+
+    struct msg_buf *buf = (struct msg_buf *)node;
+    pool_release(buf->owner, buf);
   }
 
+  // Every node was recycled; leave the sinks empty
+  for (size_t i = 0; i < num_sinks; i++) {
+    sinks[i].head.next = NULL;
+    sinks[i].list.last = &sinks[i].head;
+    atomic_store(&sinks[i].list.count, 0);
+  }
+  free(heap);
   return total;
 }
 
-static void *run_client(void *args) {
-  struct client_args *cargs = (struct client_args *)args;
-  int cfd = cargs->cfd;
-  set_non_blocking(cfd);
+void deque_init(struct conn_deque *dq) {
+  pthread_mutex_init(&dq->lock, NULL);
+  dq->items = malloc(DEQUE_INIT_CAP * sizeof(struct conn *));
+  if (dq->items == NULL) {
+    handle_error("malloc");
+  }
+  dq->head = 0;
+  dq->len = 0;
+  dq->cap = DEQUE_INIT_CAP;
+}
+
+void deque_destroy(struct conn_deque *dq) {
+  free(dq->items);
+  pthread_mutex_destroy(&dq->lock);
+}
+
+void deque_push_tail(struct conn_deque *dq, struct conn *c) {
+  pthread_mutex_lock(&dq->lock);
+  if (dq->len == dq->cap) {
+    // Unroll the ring into a buffer twice the size
+    struct conn **items = malloc(2 * dq->cap * sizeof(struct conn *));
+    if (items == NULL) {
+      handle_error("malloc");
+    }
+    for (size_t i = 0; i < dq->len; i++) {
+      items[i] = dq->items[(dq->head + i) % dq->cap];
+    }
+    free(dq->items);
+    dq->items = items;
+    dq->head = 0;
+    dq->cap *= 2;
+  }
+  dq->items[(dq->head + dq->len) % dq->cap] = c;
+  dq->len++;
+  pthread_mutex_unlock(&dq->lock);
+}
+
+size_t deque_len(struct conn_deque *dq) {
+  pthread_mutex_lock(&dq->lock);
+  size_t len = dq->len;
+  pthread_mutex_unlock(&dq->lock);
+  return len;
+}
+
+struct conn *deque_pop_head(struct conn_deque *dq) {
+  struct conn *c = NULL;
+  pthread_mutex_lock(&dq->lock);
+  if (dq->len > 0) {
+    c = dq->items[dq->head];
+    dq->head = (dq->head + 1) % dq->cap;
+    dq->len--;
+  }
+  pthread_mutex_unlock(&dq->lock);
+  return c;
+}
+
+struct conn *deque_pop_tail(struct conn_deque *dq) {
+  struct conn *c = NULL;
+  pthread_mutex_lock(&dq->lock);
+  if (dq->len > 0) {
+    dq->len--;
+    c = dq->items[(dq->head + dq->len) % dq->cap];
+  }
+  pthread_mutex_unlock(&dq->lock);
+  return c;
+}
+
+// Try every other worker once, starting with our right neighbour
+static struct conn *steal_conn(struct worker *self) {
+  struct worker_pool *pool = self->pool;
+  for (size_t i = 1; i < pool->num_workers; i++) {
+    struct worker *victim =
+        &pool->workers[(self->id + i) % pool->num_workers];
+    struct conn *c = deque_pop_tail(&victim->deque);
+    if (c != NULL) {
+      return c;
+    }
+  }
+  return NULL;
+}
+
+// Send the acks still queued before the socket closes, since the client may
+// be waiting for them. The socket is made blocking with a send timeout, so a
+// client that stopped reading holds things up by a bounded amount.
+static void drain_acks(struct conn *c) {
+  if (c->ack_len == 0) {
+    return;
+  }
+  struct timeval timeout = {.tv_sec = 0, .tv_usec = ACK_DRAIN_TIMEOUT_US};
+  int flags = fcntl(c->cfd, F_GETFL);
+  if (flags == -1 || fcntl(c->cfd, F_SETFL, flags & ~O_NONBLOCK) == -1 ||
+      setsockopt(c->cfd, SOL_SOCKET, SO_SNDTIMEO, &timeout,
+                 sizeof(timeout)) == -1) {
+    return;
+  }
+  size_t sent = 0;
+  while (sent < c->ack_len) {
+    ssize_t n =
+        send(c->cfd, c->acks + sent, c->ack_len - sent, MSG_NOSIGNAL);
+    if (n == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    sent += n;
+  }
+  c->ack_len = 0;
+}
+
+// A half-filled buffer goes to the caller's pool, not necessarily the one it
+// came from, since that pool may belong to a worker that is still running.
+static void close_conn(struct conn *c, struct buf_pool *pool) {
+  if (c->rx != NULL) {
+    pool_release(pool, c->rx);
+  }
+  drain_acks(c);
+  if (close(c->cfd) == -1) {
+    perror("client close");
+  }
+  free(c);
+}
+
+// Write as many pending acks as the socket takes. Returns false if the
+// client has gone away.
+static bool flush_acks(struct conn *c) {
+  if (c->ack_len == 0) {
+    return true;
+  }
+  ssize_t n = send(c->cfd, c->acks, c->ack_len, MSG_NOSIGNAL);
+  if (n == -1) {
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+  }
+  memmove(c->acks, c->acks + n, c->ack_len - n);
+  c->ack_len -= n;
+  return true;
+}
 
-  char msg_buf[BUF_SIZE];
+// Read whatever the client has sent so far, handing every complete frame to
+// the sink (and queueing its ack if `ack` is set). Returns false once the
+// connection is finished.
+static bool service_conn(struct msg_sink *sink, struct conn *c, bool ack,
+                         bool *progress) {
+  if (ack) {
+    if (!flush_acks(c)) {
+      return false;
+    }
+    // A client that doesn't read its acks doesn't get to send more
+    if (c->ack_len + MAX_FRAMES_PER_TURN * sizeof(struct msg_ack) >
+        ACK_BUF_SIZE) {
+      return true;
+    }
+  }
 
-  while (cargs->run) {
-    ssize_t bytes_read = read(cfd, &msg_buf, BUF_SIZE);
+  for (int i = 0; i < MAX_FRAMES_PER_TURN; i++) {
+    if (c->rx == NULL) {
+      c->rx = pool_acquire(&sink->pool);
+    }
+    ssize_t bytes_read =
+        read(c->cfd, c->rx->data + c->filled, BUF_SIZE - c->filled);
     if (bytes_read == -1) {
-      if (!(errno == EAGAIN || errno == EWOULDBLOCK)) {
-        perror("Problem reading from socket!\n");
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
         break;
       }
-    } else if (bytes_read > 0) {
-      // Create node with data
-      struct list_node *new_node = malloc(sizeof(struct list_node));
-      new_node->next = NULL;
-      new_node->data = malloc(BUF_SIZE);
-      memcpy(new_node->data, msg_buf, BUF_SIZE);
-
-      struct list_handle *list_handle = cargs->list_handle;
-      // TODO: Safely use add_to_list to add new_node to the list
-      pthread_mutex_lock(cargs->list_lock);
-      add_to_list(list_handle, new_node);
-      pthread_mutex_unlock(cargs->list_lock);
+      perror("Problem reading from socket!\n");
+      return false;
+    } else if (bytes_read == 0) {
+      // Client closed the connection
+      return false;
+    }
+
+    *progress = true;
+    c->filled += bytes_read;
+    if (c->filled < BUF_SIZE) {
+      continue;
+    }
+    c->filled = 0;
+
+    // The buffer becomes the node
+    struct list_node *new_node = &c->rx->node;
+    new_node->next = NULL;
+    new_node->data = c->rx->data;
+    c->rx = NULL;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    new_node->recv_ns = (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+    new_node->seq = c->frames++;
+
+    add_to_list(&sink->list, new_node);
+
+    if (ack) {
+      struct msg_ack a = {
+          .seq = htobe64(new_node->seq),
+          .recv_ns = htobe64(new_node->recv_ns),
+      };
+      memcpy(c->acks + c->ack_len, &a, sizeof(a));
+      c->ack_len += sizeof(a);
     }
   }
 
-  if (close(cfd) == -1) {
-    perror("client thread close");
+  return !ack || flush_acks(c);
+}
+
+static void *run_worker(void *args) {
+  struct worker *self = (struct worker *)args;
+  struct worker_pool *pool = self->pool;
+  const struct timespec idle = {.tv_sec = 0, .tv_nsec = IDLE_SLEEP_NS};
+  size_t idle_turns = 0;
+
+  while (pool->run) {
+    struct conn *c = deque_pop_head(&self->deque);
+    if (c == NULL) {
+      c = steal_conn(self);
+    }
+    if (c == NULL) {
+      nanosleep(&idle, NULL);
+      continue;
+    }
+
+    bool progress = false;
+    if (service_conn(self->sink, c, pool->ack, &progress)) {
+      deque_push_tail(&self->deque, c);
+    } else {
+      close_conn(c, &self->sink->pool);
+    }
+
+    // Nap once a whole round over our queue turned up nothing to read
+    idle_turns = progress ? 0 : idle_turns + 1;
+    if (idle_turns > deque_len(&self->deque)) {
+      nanosleep(&idle, NULL);
+      idle_turns = 0;
+    }
   }
+
   return NULL;
 }
 
+static void start_pool(struct worker_pool *pool, size_t num_workers, bool ack,
+                       struct msg_sink *sinks) {
+  pool->run = true;
+  pool->ack = ack;
+  pool->num_workers = num_workers;
+  pool->workers = calloc(num_workers, sizeof(struct worker));
+  if (pool->workers == NULL) {
+    handle_error("calloc");
+  }
+
+  // Every deque must exist before any worker starts stealing
+  for (size_t i = 0; i < num_workers; i++) {
+    pool->workers[i].id = i;
+    pool->workers[i].sink = &sinks[i];
+    pool->workers[i].pool = pool;
+    deque_init(&pool->workers[i].deque);
+  }
+  for (size_t i = 0; i < num_workers; i++) {
+    if (pthread_create(&pool->workers[i].thread, NULL, run_worker,
+                       &pool->workers[i]) != 0) {
+      handle_error("pthread_create");
+    }
+  }
+}
+
+static void stop_pool(struct worker_pool *pool) {
+  pool->run = false;
+  for (size_t i = 0; i < pool->num_workers; i++) {
+    pthread_join(pool->workers[i].thread, NULL);
+  }
+
+  // Close the connections that were still open
+  for (size_t i = 0; i < pool->num_workers; i++) {
+    struct conn *c;
+    while ((c = deque_pop_head(&pool->workers[i].deque)) != NULL) {
+      close_conn(c, &pool->workers[i].sink->pool);
+    }
+    deque_destroy(&pool->workers[i].deque);
+  }
+  free(pool->workers);
+}
+
 static void *run_acceptor(void *args) {
   int sfd = init_server_socket();
   set_non_blocking(sfd);
 
   struct acceptor_args *aargs = (struct acceptor_args *)args;
-  pthread_t threads[MAX_CLIENTS];
-  struct client_args client_args[MAX_CLIENTS];
+  struct worker_pool pool;
+  start_pool(&pool, aargs->num_workers, aargs->ack, aargs->sinks);
 
-  printf("Accepting clients...\n");
+  printf("Accepting clients with %zu workers...\n", aargs->num_workers);
 
-  uint16_t num_clients = 0;
+  size_t num_clients = 0;
   while (aargs->run) {
-    if (num_clients < MAX_CLIENTS) {
-      int cfd = accept(sfd, NULL, NULL);
-      if (cfd == -1) {
-        if (!(errno == EAGAIN || errno == EWOULDBLOCK)) {
-          handle_error("accept");
-        }
-      } else {
-        printf("Client connected!\n");
-
-        client_args[num_clients].cfd = cfd;
-        client_args[num_clients].run = true;
-        client_args[num_clients].list_handle = aargs->list_handle;
-        client_args[num_clients].list_lock = aargs->list_lock;
-        num_clients++;
-
-        // TODO: Create a new thread to handle the client
-        pthread_create(&threads[num_clients - 1], NULL, run_client,
-                       &client_args[num_clients - 1]);
+    int cfd = accept(sfd, NULL, NULL);
+    if (cfd == -1) {
+      if (!(errno == EAGAIN || errno == EWOULDBLOCK)) {
+        handle_error("accept");
       }
+      continue;
     }
+    set_non_blocking(cfd);
+
+    struct conn *c = malloc(sizeof(struct conn));
+    if (c == NULL) {
+      handle_error("malloc");
+    }
+    c->cfd = cfd;
+    c->filled = 0;
+    c->frames = 0;
+    c->rx = NULL;
+    c->ack_len = 0;
+
+    // Deal new clients out round robin; stealing evens out the rest
+    deque_push_tail(&pool.workers[num_clients % pool.num_workers].deque, c);
+    num_clients++;
   }
 
-  printf("Not accepting any more clients!\n");
+  printf("Not accepting any more clients! (%zu connected)\n", num_clients);
 
   // Shutdown and cleanup
-  for (int i = 0; i < num_clients; i++) {
-    // TODO: Set flag to stop the client thread
-    client_args[i].run = false;
-    // TODO: Wait for the client thread and close its socket
-    pthread_join(threads[i], NULL);
-  }
+  stop_pool(&pool);
 
   if (close(sfd) == -1) {
     perror("closing server socket");
@@ -217,55 +681,91 @@ static void *run_acceptor(void *args) {
   return NULL;
 }
 
-int main() {
-  pthread_mutex_t list_mutex;
-  pthread_mutex_init(&list_mutex, NULL);
-
-  // List to store received messages
-  // - Do not free list head (not dynamically allocated)
-  struct list_node head = {NULL, NULL};
-  struct list_node *last = &head;
-  struct list_handle list_handle = {
-      .last = &head,
-      .count = 0,
-  };
+static void usage(const char *prog) {
+  fprintf(stderr,
+          "Usage: %s [-c clients] [-m messages per client] [-w workers] "
+          "[-a]\n",
+          prog);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+  long num_clients = DEFAULT_NUM_CLIENTS;
+  long msg_per_client = NUM_MSG_PER_CLIENT;
+  long num_workers = sysconf(_SC_NPROCESSORS_ONLN);
+  bool ack = false;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "c:m:w:a")) != -1) {
+    switch (opt) {
+    case 'c':
+      num_clients = strtol(optarg, NULL, 10);
+      break;
+    case 'm':
+      msg_per_client = strtol(optarg, NULL, 10);
+      break;
+    case 'w':
+      num_workers = strtol(optarg, NULL, 10);
+      break;
+    case 'a':
+      ack = true;
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  if (num_clients <= 0 || msg_per_client <= 0) {
+    usage(argv[0]);
+  }
+  if (num_workers <= 0) {
+    num_workers = 1;
+  }
+  const uint32_t expected = num_clients * msg_per_client;
+
+  // Per-worker message lists
+  // - Sink heads are not freed individually (part of the sinks array)
+  size_t sinks_size = num_workers * sizeof(struct msg_sink);
+  struct msg_sink *sinks = aligned_alloc(CACHE_LINE, sinks_size);
+  if (sinks == NULL) {
+    handle_error("aligned_alloc");
+  }
+  init_sinks(sinks, num_workers);
 
   pthread_t acceptor_thread;
   struct acceptor_args aargs = {
       .run = true,
-      .list_handle = &list_handle,
-      .list_lock = &list_mutex,
+      .ack = ack,
+      .num_workers = num_workers,
+      .sinks = sinks,
   };
   pthread_create(&acceptor_thread, NULL, run_acceptor, &aargs);
 
   // TODO: Wait until enough messages are received
-  while (true) {
-    pthread_mutex_lock(&list_mutex);
-    if (list_handle.count >= MAX_CLIENTS * NUM_MSG_PER_CLIENT) {
-      pthread_mutex_unlock(&list_mutex);
-      break;
-    }
-    pthread_mutex_unlock(&list_mutex);
+  const struct timespec poll = {.tv_sec = 0, .tv_nsec = POLL_SLEEP_NS};
+  while (count_all(sinks, num_workers) < expected) {
+    nanosleep(&poll, NULL);
   }
 
   aargs.run = false;
   pthread_join(acceptor_thread, NULL);
 
-  if (list_handle.count != MAX_CLIENTS * NUM_MSG_PER_CLIENT) {
+  uint32_t received = count_all(sinks, num_workers);
+  if (received != expected) {
     printf("Not enough messages were received!\n");
     return 1;
   }
 
-  int collected = collect_all(head);
+  int collected = collect_all(sinks, num_workers);
   printf("Collected: %d\n", collected);
-  if (collected != list_handle.count) {
+  if (collected != received) {
     printf("Not all messages were collected!\n");
     return 1;
   } else {
     printf("All messages were collected!\n");
   }
 
-  pthread_mutex_destroy(&list_mutex);
+  destroy_sinks(sinks, num_workers);
+  free(sinks);
 
   return 0;
-}
\ No newline at end of file
+}